@@ -81,6 +81,7 @@
 #include <stdint.h>
 
 extern void free(void*);
+extern void* heap_grow(uintptr_t, uintptr_t*);
 extern Header  *_kr_malloc_freep;
 #ifdef MALLOC_LOCKED
 #include <mutex/mutex.h>
@@ -109,7 +110,8 @@ __malloc_init(void *bss_p, void *top_p)
 #define round_up(address, size) ((((address) + (size-1)) & (~(size-1))))
 
 /*
- * sbrk equiv
+ * sbrk equiv, takes frames from the frame table of sos once
+ * the initial area is used up (see sos/mm/heap.c)
  */
 Header  *
 morecore(unsigned nu)
@@ -123,7 +125,12 @@ morecore(unsigned nu)
 	nb = round_up(nu * sizeof(Header), NALLOC);
 
 	if (__malloc_bss + nb > __malloc_top) {
-		return NULL;
+		cp = (uintptr_t) heap_grow(nu * sizeof(Header), &nb);
+		if (cp == 0) {
+			return NULL;
+		}
+		__malloc_bss = cp;
+		__malloc_top = cp + nb;
 	}
 	__malloc_bss += nb;
 	up = (Header *) cp;
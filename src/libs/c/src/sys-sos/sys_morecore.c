@@ -81,6 +81,7 @@
 #include <stdint.h>
 
 extern void free(void*);
+extern void* sbrk(intptr_t);
 extern Header  *_kr_malloc_freep;
 #ifdef MALLOC_LOCKED
 #include <mutex/mutex.h>
@@ -112,7 +113,8 @@ __malloc_init(void *bss_p, void *top_p)
 #define round_up(address, size) ((((address) + (size-1)) & (~(size-1))))
 
 /*
- * sbrk equiv
+ * Grows the heap with the sbrk syscall of sos once the initial
+ * area is used up
  */
 Header  *
 morecore(unsigned nu)
@@ -126,7 +128,12 @@ morecore(unsigned nu)
 	nb = round_up(nu * sizeof(Header), NALLOC);
 
 	if (__malloc_bss + nb > __malloc_top) {
-		return NULL;
+		cp = (uintptr_t) sbrk(nb);
+		if (cp == (uintptr_t) -1) {
+			return NULL;
+		}
+		__malloc_bss = cp;
+		__malloc_top = cp + nb;
 	}
 	__malloc_bss += nb;
 	up = (Header *) cp;
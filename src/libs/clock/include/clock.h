@@ -11,6 +11,9 @@
 #define CLOCK_R_CNCL (-2)	/* operation cancelled (driver stopped) */
 #define CLOCK_R_FAIL (-3)	/* operation failed for other reason */
 
+/** Alarms due within this many microseconds are run right away by the timer interrupt */
+#define CLOCK_ALARM_SLACK 500
+
 typedef uint64_t timestamp_t;
 
 struct al;
@@ -41,6 +44,16 @@ int start_timer(void);
  */
 int register_timer(uint64_t delay, L4_ThreadId_t client);  
 
+/*
+ * Register a function to be called once a delay has passed.
+ *    delay:    Delay time in microseconds.
+ *    owner:    Passed to the function (timers are removed per owner).
+ *    function: Called in the root server once the timer rings.
+ *
+ * Returns CLOCK_R_OK iff successful.
+ */
+int register_alarm(uint64_t delay, L4_ThreadId_t owner, alarm_function function);
+
 /*
  * Removes all currently registred timers for a given thread.
  *    tid:    Thread ID.
@@ -15,8 +15,8 @@
  * whenever it reaches zero. In that case timer0_irq is called
  * as the interrupt handler. The alarm_timer has an alarm_function
  * which is called by the interrupt handler when the alarm is triggered.
- * Currently we use only wakeup since we only register timers for sleep
- * calls. But the way we implemented it, we could extend it easily.
+ * Sleep calls use wakeup, other parts of the root server register
+ * their own alarm functions with register_alarm (e.g. load control).
  *
  * The timestamp timer is started in start_timer and interrupts every time
  * its register overflows. We maintain a current_timestamp_high value where
@@ -35,6 +35,7 @@
 #include "clock.h"
 #include "nslu2.h"
 #include "../../../sos/libsos.h"
+#include "../../../sos/mm/slab.h"
 
 #define verbose 1
 
@@ -43,6 +44,9 @@ static timestamp_t current_timestamp_high = 0ULL;
 static alarm_timer* timer_queue_head = NULL;
 static L4_Bool_t driver_initialized = FALSE;
 
+/** Object cache for the alarm timers (see slab.c) */
+static slab_cache alarm_cache = SLAB_CACHE_INITIALIZER("alarm timer", alarm_timer);
+
 // Register Mapping
 static L4_ThreadId_t timestamp_irq_tid;
 static L4_ThreadId_t timer0_irq_tid;
@@ -197,10 +201,10 @@ int timer0_irq(L4_ThreadId_t tid, L4_Msg_t* msg_p) {
 	while(timer_queue_head != NULL) {
 			timestamp_t delay = timer_queue_head->expiration_time - get_time_stamp();
 
-			if( ((int64_t) delay) <= 500) { // TODO: is 500 a good value?
+			if( ((int64_t) delay) <= CLOCK_ALARM_SLACK) {
 				alarm_timer* alarm = timer_queue_pop();
 				alarm->alarm_function(alarm->owner, CLOCK_R_OK);
-				free(alarm);
+				slab_free(alarm);
 			}
 			else {
 				// set alarm and return
@@ -237,29 +241,40 @@ static void wakeup(L4_ThreadId_t tid, int status) {
 }
 
 
+/**
+ * Inserts a new alarm timer for a sleep call in the timer queue.
+ * The alarm_function of the timer wakes up the client.
+ *
+ * @param delay microseconds when the timer should be triggered
+ * @param client which user should be triggered
+ * @return see register_alarm
+ */
+int register_timer(uint64_t delay, L4_ThreadId_t client) {
+	return register_alarm(delay, client, &wakeup);
+}
+
+
 /**
  * Inserts a new alarm timer in the timer queue. This will also restart
  * the timer whenever we have a new head element.
- * Notice that this will construct a alarm_timer struct and set its
- * alarm_function to point to wakeup. Since we only support sleep
- * right now this is ok.
  *
  * @param delay microseconds when the timer should be triggered
- * @param client which user should be triggered
+ * @param owner owner of the timer (passed to the function)
+ * @param function called from the timer interrupt handler once the timer rings
  * @return CLOCK_R_OK if the timer driver is started
  * 		   CLOCK_R_UNIT if the driver is not started yet
  * 		   CLOCK_R_FAIL if we don't have memory for our alarm_timer
  */
-int register_timer(uint64_t delay, L4_ThreadId_t client) {
+int register_alarm(uint64_t delay, L4_ThreadId_t owner, alarm_function function) {
 	if(!driver_initialized)
 		return CLOCK_R_UINT;
 
-	alarm_timer* new_alarm = malloc( sizeof(alarm_timer) ); // free'd in interrupt handler
+	alarm_timer* new_alarm = slab_alloc(&alarm_cache); // free'd in interrupt handler
 	if(new_alarm == NULL)
 		return CLOCK_R_FAIL;
 
-	new_alarm->alarm_function = &wakeup;
-	new_alarm->owner = client;
+	new_alarm->alarm_function = function;
+	new_alarm->owner = owner;
 	new_alarm->next_alarm = NULL;
 	new_alarm->expiration_time = get_time_stamp() + delay;
 
@@ -273,7 +288,7 @@ int register_timer(uint64_t delay, L4_ThreadId_t client) {
 		TIMER0_SET(MICROSECONDS_TO_TICKS(delay));
 		TIMER0_START();
 
-		dprintf(1, "register_timer: new front timer: Next alarm in: %lld us\n", delay);
+		dprintf(1, "register_alarm: new front timer: Next alarm in: %lld us\n", delay);
 	}
 
 	return CLOCK_R_OK;
@@ -305,7 +320,7 @@ void remove_timers(L4_ThreadId_t tid) {
 			TIMER0_SET(MICROSECONDS_TO_TICKS(delay));
 			TIMER0_START();
 		}
-		free(to_delete);
+		slab_free(to_delete);
 	}
 
 	// remove all queue entries further down the queue belonging to tid
@@ -317,7 +332,7 @@ void remove_timers(L4_ThreadId_t tid) {
 			dprintf(1,"remove entry from timer queue, belonging to tid = 0x%X\n", tid);
 			alarm_timer* to_delete = (*atp)->next_alarm;
 			(*atp)->next_alarm = (*atp)->next_alarm->next_alarm;
-			free(to_delete);
+			slab_free(to_delete);
 		}
 
 	}
@@ -358,7 +373,7 @@ int stop_timer(void) {
 	alarm_timer* al = NULL;
 	while( (al = timer_queue_pop()) != NULL ) {
 		al->alarm_function(al->owner, CLOCK_R_CNCL);
-		free(al);
+		slab_free(al);
 	}
 
 	driver_initialized = FALSE;
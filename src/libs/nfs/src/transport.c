@@ -14,6 +14,7 @@
 #include "transport.h"
 
 #include "libsos.h"
+#include "mm/slab.h"
 
 #define UDP_PAYLOAD (1200) //500 // 0 - 1490
 
@@ -53,6 +54,9 @@ struct rpc_queue
 
 struct rpc_queue *queue = NULL;
 
+/* Object cache for the queue items (see sos/mm/slab.c) */
+static slab_cache rpc_queue_cache = SLAB_CACHE_INITIALIZER("rpc queue", struct rpc_queue);
+
 /************************************************************
  *  XID Code 
  ***********************************************************/
@@ -352,7 +356,7 @@ add_to_queue(struct pbuf *pbuf, int port,
     /* Need a lock here */
     struct rpc_queue *q_item;
     struct rpc_queue *tmp;
-    q_item = malloc(sizeof(struct rpc_queue));
+    q_item = slab_alloc(&rpc_queue_cache);
     assert(q_item != NULL);
 
     q_item->next = NULL;
@@ -420,7 +424,7 @@ my_recv(void *arg, struct udp_pcb *upcb, struct pbuf *p,
     /* Free our memory */
     pbuf_free(p);
     pbuf_free(q_item->pbuf);
-    free(q_item);
+    slab_free(q_item);
 }
 
 /* Send a packet to a specific port. It would be nice if 
@@ -4,6 +4,7 @@
 #define _SOS_H
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <l4/types.h>
 #include <l4/ipc.h>
 #include <tty.h>
@@ -82,11 +83,21 @@ int stat(const char *path, stat_t *buf);
  *  PROCESS_TABLE_FULL
  *  FILE_NOT_EXECUTABLE
  *  FILE_TOO_BIG
+ *  INVALID_EXECUTABLE
  *  (see process_shared.h)
  */
 pid_t process_create(const char *path);
 
 
+/**
+ * Creates a copy of the calling process. The memory of the copy
+ * is shared copy on write with the caller, open files are not
+ * inherited. Returns the pid of the new process to the caller and
+ * 0 in the new process, or PROCESS_TABLE_FULL.
+ */
+pid_t process_clone(void);
+
+
 /**
  * Delete process (and close all its file descriptors).
  * Returns 0 if successful, -1 otherwise (invalid process).
@@ -113,22 +124,6 @@ int process_status(process_t *processes, unsigned max);
 pid_t process_wait(pid_t pid);
 
 
-/**
- * This is an internal syscall used by the initializer after the ELF file has been loaded
- * into memory to tell the SOS server to start the binary. This syscall is only invoked
- * once (not by the user) after that it will no longer work and always return -1.
- */
-int process_start(int);
-
-
-/**
- * This is an internal syscall used by the initializer to find out which file to load.
- * This syscall will not worked after the initializer has completed and therefore
- * should not be used in user programs.
- */
-int process_get_name(char*);
-
-
 /**
  * Returns time in microseconds since booting.
  */
@@ -160,6 +155,50 @@ void sleep(int msec);
 int share_vm(void *adr, size_t size, int writable);
 
 
+/* Memory system calls */
+
+/**
+ * Copies the virtual memory statistics of the SOS server into "stats".
+ * Returns 0 if successful, -1 otherwise (invalid buffer).
+ */
+int vm_stats(vm_stats_t* stats);
+
+
+/**
+ * Sets the free frame watermarks of the page-out daemon. Pages are
+ * swapped out in the background as soon as less than "low" frames are
+ * free, until "high" frames are free again.
+ * Returns 0 if successful, -1 otherwise (low > high).
+ */
+int vm_set_watermarks(unsigned low, unsigned high);
+
+
+/**
+ * Moves the end of the heap by "increment" bytes (which may be
+ * negative). Pages above a lowered end are freed.
+ * Returns the previous end of the heap if successful, (void*) -1
+ * otherwise (the heap would exceed its limit).
+ */
+void* sbrk(intptr_t increment);
+
+
+/**
+ * Sets the maximum heap size of process "pid" to "limit" bytes.
+ * Returns 0 if successful, -1 otherwise (invalid pid, limit smaller
+ * than the current heap or larger than the heap region).
+ */
+int vm_set_heap_limit(pid_t pid, size_t limit);
+
+
+/**
+ * Sets the frame quota of process "pid". Once "frames" of its pages
+ * are resident the process swaps out its own pages to get new ones.
+ * A quota of 0 removes the limit.
+ * Returns 0 if successful, -1 otherwise (invalid pid).
+ */
+int vm_set_frame_quota(pid_t pid, unsigned frames);
+
+
 /* Debug Syscalls */
 void sos_debug_flush(void);
 
@@ -1,7 +1,11 @@
 #include <assert.h>
 #include <string.h>
+#include <setjmp.h>
 #include <sos.h>
 
+/** Where a clone continues (copied to the clone with the rest of the data) */
+static jmp_buf clone_context;
+
 pid_t process_create(const char *path) {
 	if(path == NULL)
 		return -1;
@@ -28,6 +32,31 @@ pid_t process_create(const char *path) {
 }
 
 
+/**
+ * Entry point of a clone. Returns from process_clone in the
+ * copy of the stack of the parent.
+ */
+static void clone_entry(void) {
+	ipc_memory_start[0] = 0; // make sure our own ipc memory is mapped before the first syscall
+	longjmp(clone_context, 1);
+}
+
+
+pid_t process_clone(void) {
+	if(setjmp(clone_context) != 0)
+		return 0;
+
+	// the clone needs a bit of stack for clone_entry below what we're using now
+	L4_Word_t stack = ((L4_Word_t)__builtin_frame_address(0) - 1024) & ~0x7;
+
+	L4_Msg_t msg;
+	L4_MsgTag_t tag = system_call(SOS_PROCESS_CLONE, &msg, 2, (L4_Word_t)&clone_entry, stack);
+	assert(L4_UntypedWords(tag) == 1);
+
+	return (pid_t) L4_MsgWord(&msg, 0);
+}
+
+
 int process_delete(pid_t pid) {
     L4_Msg_t msg;
 	L4_MsgTag_t tag = system_call(SOS_PROCESS_DELETE, &msg, 1, pid);
@@ -73,30 +102,3 @@ pid_t process_wait(pid_t pid) {
 
 	return L4_MsgWord(&msg, 0);
 }
-
-
-int process_start(int err) {
-	L4_Msg_t msg;
-	system_call(SOS_PROCESS_START, &msg, 1, err);
-	return 0;
-}
-
-
-int process_get_name(char* name) {
-	if(name == NULL)
-		return -1;
-
-	// Don't do printf here as it will fuck up your ipc_memory and you need it
-	// at least until after you did strcpy
-	ipc_memory_start[0] = 's'; // make sure the memory is mapped somewhere
-
-	L4_Msg_t msg;
-	L4_MsgTag_t tag = system_call(SOS_PROCESS_GET_NAME, &msg, 0);
-	assert(L4_UntypedWords(tag) == 1);
-
-	int ret = L4_MsgWord(&msg, 0);
-	if(ret == 0)
-		strcpy(name, ipc_memory_start);
-
-	return ret;
-}
@@ -0,0 +1,57 @@
+#include <assert.h>
+#include <string.h>
+#include <sos.h>
+
+
+int vm_stats(vm_stats_t* stats) {
+	if(stats == NULL)
+		return -1;
+
+	ipc_memory_start[0] = 's'; // make sure the memory is mapped somewhere
+
+	L4_Msg_t msg;
+	L4_MsgTag_t tag = system_call(SOS_VM_STATS, &msg, 0);
+	assert(L4_UntypedWords(tag) == 1);
+
+	int ret = L4_MsgWord(&msg, 0);
+	if(ret == 0)
+		memcpy(stats, ipc_memory_start, sizeof(vm_stats_t));
+
+	return ret;
+}
+
+
+int vm_set_watermarks(unsigned low, unsigned high) {
+	L4_Msg_t msg;
+	L4_MsgTag_t tag = system_call(SOS_VM_WATERMARKS, &msg, 2, low, high);
+	assert(L4_UntypedWords(tag) == 1);
+
+	return L4_MsgWord(&msg, 0);
+}
+
+
+void* sbrk(intptr_t increment) {
+	L4_Msg_t msg;
+	L4_MsgTag_t tag = system_call(SOS_SBRK, &msg, 1, increment);
+	assert(L4_UntypedWords(tag) == 1);
+
+	return (void*) L4_MsgWord(&msg, 0);
+}
+
+
+int vm_set_heap_limit(pid_t pid, size_t limit) {
+	L4_Msg_t msg;
+	L4_MsgTag_t tag = system_call(SOS_HEAP_LIMIT, &msg, 2, pid, limit);
+	assert(L4_UntypedWords(tag) == 1);
+
+	return L4_MsgWord(&msg, 0);
+}
+
+
+int vm_set_frame_quota(pid_t pid, unsigned frames) {
+	L4_Msg_t msg;
+	L4_MsgTag_t tag = system_call(SOS_FRAME_QUOTA, &msg, 2, pid, frames);
+	assert(L4_UntypedWords(tag) == 1);
+
+	return L4_MsgWord(&msg, 0);
+}
@@ -8,12 +8,16 @@
 #define PROCESS_TABLE_FULL -2
 #define FILE_NOT_EXECUTABLE -3
 #define FILE_TOO_BIG -4
+#define INVALID_EXECUTABLE -5
 
 typedef int pid_t;
 
 typedef struct {
   pid_t     pid;
   unsigned  size;		/* in pages */
+  unsigned  resident;		/* pages in memory which can be swapped out */
+  unsigned  working_set;	/* pages used in the last revolution of the clock */
+  unsigned  quota;		/* maximum resident pages (0 = no limit) */
   unsigned  stime;		/* start time in msec since booting */
   unsigned  ctime;		/* CPU time accumulated in msec */
   char	    command[N_NAME];	/* Name of exectuable */
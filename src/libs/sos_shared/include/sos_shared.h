@@ -12,6 +12,7 @@
 #include "syscalls.h"
 #include "process_shared.h"
 #include "io_shared.h"
+#include "vm_shared.h"
 
 
 #define IPC_MAX_WORDS 64
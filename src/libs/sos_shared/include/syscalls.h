@@ -22,12 +22,11 @@
 
 // Process Syscall Labels
 #define SOS_PROCESS_CREATE		 6
-#define SOS_PROCESS_START		 7
+#define SOS_PROCESS_CLONE		 7
 #define SOS_PROCESS_DELETE		 8
 #define SOS_PROCESS_ID 			 9
 #define SOS_PROCESS_STATUS		10
 #define SOS_PROCESS_WAIT 		11
-#define SOS_PROCESS_GET_NAME	12
 
 // IO Syscall Labels
 #define SOS_SLEEP 			13
@@ -36,4 +35,11 @@
 // Debug Syscall Labels
 #define SOS_UNMAP_ALL		15
 
+// Memory Syscall Labels
+#define SOS_VM_STATS		16
+#define SOS_VM_WATERMARKS	17
+#define SOS_SBRK			18
+#define SOS_HEAP_LIMIT		19
+#define SOS_FRAME_QUOTA		20
+
 #endif /* SYSCALLS_H_ */
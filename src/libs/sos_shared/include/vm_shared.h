@@ -0,0 +1,92 @@
+#ifndef VM_SHARED_H_
+#define VM_SHARED_H_
+
+/** Number of slab caches reported in vm_stats_t */
+#define VM_SLAB_CACHES 16
+
+/** Usage of one object cache of the root server (see slab.c) */
+typedef struct slab_stats {
+	char name[16];				/* name of the cache */
+	unsigned object_size;		/* size of the objects */
+	unsigned objects_used;		/* objects currently allocated */
+	unsigned objects_total;		/* objects in the slabs of the cache */
+	unsigned slabs;				/* slabs currently allocated from the heap */
+	unsigned bytes;				/* heap memory used by the slabs */
+	unsigned allocs;			/* allocations so far */
+	unsigned grows;				/* allocations which needed a new slab */
+} slab_stats_t;
+
+/**
+ * Virtual memory statistics maintained by the root server.
+ * A copy of it is returned by the vm_stats syscall.
+ */
+typedef struct {
+	unsigned swap_clusters;			/* number of write clusters sent to the swap file */
+	unsigned swap_cluster_pages;	/* pages written out as part of a cluster */
+	unsigned swap_max_cluster;		/* largest cluster written so far (in pages) */
+	unsigned swap_write_rpcs;		/* NFS write calls issued by the swapper */
+
+	unsigned free_frames;			/* frames currently free (stack, zero pool and buddy allocator) */
+	unsigned frame_fragmentation;	/* percent of free frames not in a free block of large page size */
+	unsigned largest_free_order;	/* largest free run of frames is 2^this frames */
+	unsigned low_watermark;			/* page-out daemon starts below this number of free frames */
+	unsigned high_watermark;		/* page-out daemon stops at this number of free frames */
+	unsigned reclaim_runs;			/* number of times the page-out daemon ran */
+	unsigned reclaim_pages;			/* pages evicted by the page-out daemon */
+	unsigned direct_reclaims;		/* page faults which found no free frame and had to swap */
+
+	unsigned clock_evictions;		/* pages selected by the clock */
+	unsigned clock_scanned;			/* pages the back hand of the clock looked at in total */
+	unsigned clock_max_scan;		/* longest scan for a single eviction */
+
+	unsigned zero_pool_hits;		/* frame allocations served by the pre-zeroed pool */
+	unsigned zero_pool_misses;		/* frame allocations which had to zero the frame themselves */
+
+	unsigned swap_slots_used;		/* pages currently stored in the swap file */
+	unsigned swap_slots_total;		/* current capacity of the swap map (grows on demand) */
+
+	unsigned page_faults;			/* page faults handled by the pager */
+	unsigned large_page_maps;		/* 64 KB blocks backed by a large page */
+	unsigned large_page_fallbacks;	/* large page candidates mapped with 4 KB pages (fragmentation/memory pressure) */
+	unsigned large_page_breaks;		/* large pages split up again because a part got evicted or freed */
+
+	unsigned exec_page_ins;			/* text and data pages read from executables on demand */
+	unsigned exec_read_rpcs;		/* NFS read calls issued for them */
+	unsigned text_cache_hits;		/* text page faults served by a frame of another instance */
+	unsigned shared_frames;			/* frames currently mapped by more than one process */
+	unsigned shared_swap_slots;		/* swap slots currently used by more than one process */
+	unsigned clones;				/* processes created by process_clone */
+	unsigned cow_copies;			/* writes to shared pages which required a copy */
+	unsigned fault_around_pages;	/* resident neighbours mapped together with a faulting page */
+	unsigned zero_page_maps;		/* anonymous pages backed by the zero page on a read */
+	unsigned stack_growths;			/* faults which extended a stack */
+	unsigned local_reclaims;		/* faults of processes at their quota (local replacement) */
+	unsigned loadctl_suspends;		/* processes suspended because of thrashing */
+	unsigned loadctl_resumes;		/* suspended processes which were resumed */
+	unsigned zswap_stores;			/* dirty pages compressed into the pool instead of written */
+	unsigned zswap_rejects;			/* dirty pages which did not fit into the pool */
+	unsigned zswap_stored_bytes;	/* compressed size of all pages stored (ratio: stores * PAGESIZE / this) */
+	unsigned zswap_writebacks;		/* pages written from the pool to the swap file */
+	unsigned zswap_chunks_used;		/* 512 byte chunks of the pool currently used */
+	unsigned zswap_chunks;			/* size of the pool in chunks */
+	unsigned zswap_hits;			/* swap ins served by the pool */
+	unsigned zswap_misses;			/* swap ins read from the swap file */
+	unsigned zswap_hit_us;			/* total time spent on swap ins from the pool (us) */
+	unsigned zswap_miss_us;			/* total time spent on swap ins from the swap file (us) */
+	unsigned readahead_pages;		/* swapped pages read ahead after sequential faults */
+	unsigned readahead_hits;		/* faults on pages which were read ahead */
+	unsigned readahead_wasted;		/* pages read ahead which were evicted without being used */
+	unsigned swap_writes_avoided;	/* evicted pages which still had a clean copy in swap or the executable */
+	unsigned merge_scanned;			/* pages hashed by the same-page merging scanner */
+	unsigned merge_zero_pages;		/* zero filled pages replaced by the zero page */
+	unsigned merge_pages;			/* pages merged with a frame with the same contents */
+	unsigned heap_frames;			/* frames currently used by the heap of the root server */
+	unsigned heap_peak_frames;		/* most frames the heap used at once */
+	unsigned heap_grows;			/* number of times the heap took frames */
+	unsigned heap_grow_failures;	/* heap growths which found no frames (or hit the limit) */
+	unsigned heap_trimmed_frames;	/* free heap frames given back to the frame table */
+	unsigned slab_cache_count;		/* valid entries in slab_caches */
+	slab_stats_t slab_caches[VM_SLAB_CACHES];
+} vm_stats_t;
+
+#endif /* VM_SHARED_H_ */
@@ -43,6 +43,7 @@
 
 #include "../mm/pager.h"
 #include "../mm/swapper.h"
+#include "../mm/slab.h"
 #include "../process.h"
 #include "../libsos.h"
 #include "../network.h"
@@ -62,6 +63,9 @@ L4_Bool_t file_cache_initialized = FALSE;
 static int file_cache_next_entry = 0;
 file_info* file_cache[DIR_CACHE_SIZE];
 
+/** Object cache for the file descriptors (see slab.c) */
+static slab_cache file_table_cache = SLAB_CACHE_INITIALIZER("file table", file_table_entry);
+
 /**
  * Inserts a file_info struct into the file_cache.
  * @param fi pointer to the file_info to insert
@@ -144,7 +148,7 @@ fildes_t find_free_file_slot(file_table_entry** file_table) {
  */
 file_table_entry* create_file_descriptor(file_info* fi, L4_ThreadId_t tid, fmode_t mode) {
 
-	file_table_entry* fte = malloc(sizeof(file_table_entry)); // freed on close()
+	file_table_entry* fte = slab_alloc(&file_table_cache); // freed on close()
 	assert(fte != NULL);
 
 	fte->file = fi;
@@ -161,6 +165,16 @@ file_table_entry* create_file_descriptor(file_info* fi, L4_ThreadId_t tid, fmode
 }
 
 
+/**
+ * Frees a file descriptor created by create_file_descriptor.
+ *
+ * @param fte the file descriptor
+ */
+void free_file_descriptor(file_table_entry* fte) {
+	slab_free(fte);
+}
+
+
 /**
  * Initializer is called in main.c by the sos server on startup (after network init).
  * This creates a special device called "console" and links it with the serial
@@ -343,7 +357,7 @@ int close_file(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
 	}
 
 	// free allocated structures
-	free(f);
+	free_file_descriptor(f);
 	get_process(tid)->filetable[fd] = NULL;
 
 	return set_ipc_reply(msg_p, 1, 0);
@@ -19,6 +19,7 @@
 #include "../libsos.h"
 #include "../network.h"
 #include "../process.h"
+#include "../mm/loader.h"
 #include "io_nfs.h"
 #include "io.h"
 
@@ -140,7 +141,7 @@ static void nfs_read_callback(uintptr_t token, int status, fattr_t *attr, int by
 	if(!f->awaits_callback) {
 		// can happen when the process was killed in the mean time (see process_delete)
 		dprintf(0, "nfs_read_callback: process 0x%X was killed :-( dont reply\n", f->owner);
-		free(f);
+		free_file_descriptor(f);
 		return;
 	}
 
@@ -184,7 +185,7 @@ static void nfs_write_callback(uintptr_t token, int status, fattr_t *attr) {
 	if(!f->awaits_callback) {
 		// can happen when the process was killed in the mean time (see process_delete)
 		dprintf(0, "nfs_write_callback: process 0x%X was killed :-( dont reply\n", f->owner);
-		free(f);
+		free_file_descriptor(f);
 		return;
 	}
 
@@ -255,9 +256,11 @@ file_info* create_nfs(char* name, L4_ThreadId_t recipient, fmode_t mode) {
 
 
 /**
- * Tell NFS to write to a given file.
+ * Tell NFS to write to a given file. Text pages cached for the
+ * file are not used for new processes anymore.
  */
 void write_nfs(file_table_entry* f) {
+	loader_file_changed(f->file);
 	nfs_write(&f->file->nfs_handle, f->write_position, f->to_write, f->client_buffer, &nfs_write_callback, (int)f);
 	f->awaits_callback = TRUE;
 }
@@ -23,6 +23,8 @@
 
 #include "mm/pager.h"
 #include "mm/frames.h"
+#include "mm/loadctl.h"
+#include "mm/merge.h"
 #include "io/io.h"
 #include "process.h"
 #include "sysent.h"
@@ -32,7 +34,7 @@
 #define verbose 1
 
 #define ONE_MEG	    (1 * 1024 * 1024)
-#define HEAP_SIZE   ONE_MEG*4 /* 4 MB heap */
+#define HEAP_INITIAL_SIZE   ONE_MEG /* holds the frame table, the heap grows with frames later (see mm/heap.c) */
 
 /** Set aside some memory for a init stack */
 #define STACK_SIZE 0x1000
@@ -46,6 +48,8 @@ static void init_thread(void)
     start_timer();
 	network_init();
 	io_init();
+	loadctl_init();
+	merge_init();
 
 	/*
     // Loop through the BootInfo starting executables
@@ -97,8 +101,33 @@ static __inline__ void syscall_loop(void)
 
 		L4_MsgTag_t tag;
 
+		// Free frames are running low, reply first so the client
+		// doesn't wait for us and then do some page-out work
+		if (pager_reclaim_needed()) {
+			if (reply)
+				L4_Reply(tid);
+			reply = 0;
+			pager_reclaim();
+		}
+
 		// Wait for a message, sometimes sending a reply
-		if (!reply)
+		if (frame_zero_needed()) {
+			// Only poll for a message, if there is none we're idle and
+			// use the time to refill the pool of zeroed frames
+			if (reply)
+				L4_Reply(tid);
+			reply = 0;
+
+			tag = L4_Niltag;
+			L4_Clear_ReceiveBlock(&tag);
+			tag = L4_Ipc(L4_nilthread, L4_anythread, tag, &tid);
+
+			if (L4_IpcFailed(tag) && L4_ErrorCode() == 3) { // no message pending
+				frame_zero_idle();
+				continue;
+			}
+		}
+		else if (!reply)
 			// Nothing to send, so we just wait
 			tag = L4_Wait(&tid);
 		else
@@ -153,6 +182,9 @@ static __inline__ void syscall_loop(void)
 					L4_PhysDesc_t phys = L4_PhysDesc((L4_Word_t)ipc_memory, L4_UncachedMemory);
 					L4_MapFpage(root_thread_g, targetFpage, phys);
 
+					// the user maps its IPC page cached, write back what it put there
+					pager_cache_flush(tid, (L4_Word_t)ipc_memory_start, PAGESIZE);
+
 					reply = sysent[sysnr](tid, &msg, ipc_memory);
 				}
 				else {
@@ -184,12 +216,12 @@ int main(void)
     L4_Word_t low, high;
     sos_find_memory(&low, &high);
 
-	__malloc_init((void*) low, (void*) ((low + HEAP_SIZE)-1));
+	__malloc_init((void*) low, (void*) ((low + HEAP_INITIAL_SIZE)-1));
 
     dprintf(0, "Available memory from 0x%08lx to 0x%08lx - %luMB\n", low, high, (high - low) / ONE_MEG);
 
     // Initialize memory management
-    frame_init((low + HEAP_SIZE), high);
+    frame_init((low + HEAP_INITIAL_SIZE), high);
     pager_init();
 
     // Initialize process structure and register root process
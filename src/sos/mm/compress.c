@@ -0,0 +1,177 @@
+/**
+ * Compression
+ * =============
+ * A small LZ77 compressor for pages (in the format of LZF). It is
+ * used by the compressed swap pool (see zswap.c) and is meant to be
+ * fast rather than to compress well.
+ *
+ * Format
+ * ------------------------------
+ * The output is a sequence of runs, each starting with a control byte:
+ * - 000LLLLL: L+1 literal bytes follow (at most 32).
+ * - LLLOOOOO [EEEEEEEE] OOOOOOOO: back reference to the data at offset
+ *   O+1 (13 bits) before the current position with a length of L+2. A
+ *   length field of 7 is extended by the following byte E, so a back
+ *   reference covers up to 264 bytes.
+ *
+ * Matches are found with a hash table over the next 3 bytes which only
+ * remembers the last position for each hash value.
+ */
+
+#include <string.h>
+
+#include "compress.h"
+
+/** Bits of the hash over 3 bytes */
+#define HASH_LOG 10
+/** Maximum number of literal bytes in a run */
+#define MAX_LITERALS 32
+/** Maximum distance of a back reference */
+#define MAX_OFFSET (1 << 13)
+/** Maximum length of a back reference */
+#define MAX_MATCH ((1 << 8) + (1 << 3))
+
+/** Last position (+1) for each hash value, 0 means none */
+static uint16_t hash_table[1 << HASH_LOG];
+
+
+/**
+ * Hashes 3 bytes.
+ * @param p pointer to the bytes
+ * @return hash value
+ */
+static inline int hash(const uint8_t* p) {
+	uint32_t v = (p[0] << 16) | (p[1] << 8) | p[2];
+	return ((v * 2654435761u) >> (32 - HASH_LOG)) & ((1 << HASH_LOG) - 1);
+}
+
+
+/**
+ * Compresses a block of at most 64 KB.
+ *
+ * @param in data to compress
+ * @param in_length number of bytes in `in`
+ * @param out buffer for the compressed data
+ * @param out_size size of `out`
+ * @return size of the compressed data or 0 if it does not fit in `out`
+ */
+int compress_block(const uint8_t* in, int in_length, uint8_t* out, int out_size) {
+	int ip = 0, op = 0;
+	int literal_pos = -1;	// control byte of the current literal run
+	int literals = 0;
+
+	memset(hash_table, 0, sizeof(hash_table));
+
+	while(ip < in_length) {
+		int length = 0;
+		int ref = -1;
+
+		if(ip + 2 < in_length) {
+			int h = hash(in + ip);
+			ref = hash_table[h] - 1;
+			hash_table[h] = ip + 1;
+
+			if(ref >= 0 && ip - ref <= MAX_OFFSET && in[ref] == in[ip] && in[ref+1] == in[ip+1] && in[ref+2] == in[ip+2]) {
+				int max_length = in_length - ip < MAX_MATCH ? in_length - ip : MAX_MATCH;
+				for(length = 3; length < max_length && in[ref+length] == in[ip+length]; length++)
+					;
+			}
+		}
+
+		if(length == 0) {
+			// literal
+			if(literal_pos < 0) {
+				if(op >= out_size)
+					return 0;
+				literal_pos = op++;
+				literals = 0;
+			}
+			if(op >= out_size)
+				return 0;
+
+			out[op++] = in[ip++];
+
+			if(++literals == MAX_LITERALS) {
+				out[literal_pos] = literals - 1;
+				literal_pos = -1;
+			}
+			continue;
+		}
+
+		// back reference
+		if(literal_pos >= 0) {
+			out[literal_pos] = literals - 1;
+			literal_pos = -1;
+		}
+		if(op + 3 > out_size)
+			return 0;
+
+		int offset = ip - ref - 1;
+		int encoded = length - 2;
+
+		if(encoded < 7) {
+			out[op++] = (encoded << 5) | (offset >> 8);
+		}
+		else {
+			out[op++] = (7 << 5) | (offset >> 8);
+			out[op++] = encoded - 7;
+		}
+		out[op++] = offset & 0xFF;
+
+		ip += length;
+	}
+
+	if(literal_pos >= 0)
+		out[literal_pos] = literals - 1;
+
+	return op;
+}
+
+
+/**
+ * Decompresses a block created by compress_block.
+ *
+ * @param in compressed data
+ * @param in_length size of the compressed data
+ * @param out buffer for the decompressed data
+ * @param out_size size of `out`
+ * @return number of decompressed bytes or -1 if the data is corrupt
+ */
+int decompress_block(const uint8_t* in, int in_length, uint8_t* out, int out_size) {
+	int ip = 0, op = 0;
+
+	while(ip < in_length) {
+		int control = in[ip++];
+
+		if(control < (1 << 5)) {
+			int literals = control + 1;
+			if(ip + literals > in_length || op + literals > out_size)
+				return -1;
+
+			memcpy(out + op, in + ip, literals);
+			ip += literals;
+			op += literals;
+		}
+		else {
+			int length = control >> 5;
+			if(length == 7) {
+				if(ip >= in_length)
+					return -1;
+				length += in[ip++];
+			}
+			if(ip >= in_length)
+				return -1;
+
+			int ref = op - ((control & 0x1F) << 8) - in[ip++] - 1;
+			length += 2;
+			if(ref < 0 || op + length > out_size)
+				return -1;
+
+			// byte by byte, the reference may overlap the output
+			for(int i=0; i<length; i++)
+				out[op++] = out[ref++];
+		}
+	}
+
+	return op;
+}
@@ -0,0 +1,9 @@
+#ifndef COMPRESS_H_
+#define COMPRESS_H_
+
+#include <stdint.h>
+
+int compress_block(const uint8_t* in, int in_length, uint8_t* out, int out_size);
+int decompress_block(const uint8_t* in, int in_length, uint8_t* out, int out_size);
+
+#endif /* COMPRESS_H_ */
@@ -1,21 +1,67 @@
 /**
  * Frame Table
  * =============
- * This is a simple stack based frame table implementation.
- * Because it's a stack add/remove operations are both in
- * O(1). To verify if a frame is currently free/used we implemented
+ * Free frames are managed by a buddy allocator with a stack of single
+ * frames in front of it. Single frames are allocated from and freed to
+ * the stack in O(1). Only if the stack is empty (or full, on free) the
+ * buddy allocator is asked, which takes at most FRAME_MAX_ORDER steps.
+ * To verify if a frame is currently free/used we implemented
  * a bit-field which tracks all frames. This allows us to check the state
  * of a given frame in O(1).
- * The Memory used for the frame management is sizeof(frame_t) (i.e. 4 bytes)
- * + 1 bit in the bit-field.
+ * The Memory used for the frame management is two words and a byte per
+ * frame for the buddy lists + 1 bit in the bit-field (plus the stack of
+ * FRAME_STACK_SIZE frames).
+ *
+ * Buddy Allocator
+ * -------------------
+ * Free memory outside of the stack is kept in blocks of 2^order frames
+ * which are aligned to their size in physical memory, one free list per
+ * order. An allocation takes a block of the smallest order which is
+ * large enough and splits off the unused halves. A freed block is
+ * merged with its buddy (the other half of the next larger block) as
+ * long as the buddy is free as well. frame_alloc_run hands out such
+ * blocks (e.g. DMA buffers); if no block is large enough the stack is
+ * drained into the buddy allocator first, so its frames can merge.
+ * The frames of a run are independent afterwards and may be freed one
+ * by one with frame_free or all at once with frame_free_run.
+ * frame_fragmentation tells which share of the free memory can't be used
+ * for a run of a given order.
+ *
+ * Pre-zeroed Frames
+ * -------------------
+ * Handing out a frame requires us to clear it, otherwise we would leak
+ * data to other processes. To get this off the page fault path we keep
+ * a second, small stack of up to ZERO_POOL_SIZE frames which are already
+ * zeroed. It is filled by frame_zero_idle while the root server has
+ * nothing else to do (see syscall_loop). frame_alloc takes frames from
+ * this pool first and only zeroes a frame itself if the pool is empty.
+ * Frames in the pool count as free in the bit-field.
+ *
+ * Core Map
+ * -------------------
+ * Next to the free stack we keep the core map, an array with one entry
+ * per frame which describes the page currently living in the frame
+ * (owner, virtual address, swap location and state bits). It is used by
+ * the swapper to get from a frame to its page in O(1) and the clock
+ * sweeps over it. Entries are reset whenever a frame is allocated.
+ * Pages shared between processes (see swapper.c) are reference
+ * counted in their core map entry.
+ *
+ * Large Frame Runs
+ * -------------------
+ * For large page mappings (see pager.c) frame_alloc_large hands out
+ * runs of PAGES_PER_LARGE_PAGE contiguous frames aligned to
+ * LARGE_PAGESIZE, which is a buddy block of LARGE_PAGE_ORDER.
  */
 
 #include <stdlib.h>
 #include <string.h>
 #include <stddef.h>
 #include <assert.h>
+#include <sos_shared.h>
 #include "../libsos.h"
 #include "../l4.h"
+#include <l4/cache.h>
 
 #include "frames.h"
 
@@ -31,6 +77,17 @@
 
 #define BITS_PER_CHAR 8
 
+/** Maximum number of pre-zeroed frames kept aside */
+#define ZERO_POOL_SIZE 32
+
+/** Maximum number of free single frames kept on the stack */
+#define FRAME_STACK_SIZE 64
+
+/** Marks the end of a free list */
+#define NO_FRAME (~0UL)
+/** Order of frames which are not the first frame of a free buddy block */
+#define NOT_FREE_BLOCK 0xFF
+
 /** List elements used to maintain a list of the free frames */
 typedef struct frame {
 	L4_Word_t address; /*!< Frame start address */
@@ -43,6 +100,20 @@ static L4_Word_t stack_count = 0; /**< Holds the current number of stack element
 static frame_t* frame_stack_start = NULL;
 static char* bitfield_start = NULL;
 
+static L4_Word_t free_head[FRAME_MAX_ORDER+1];	/**< First free block of each order (frame index or NO_FRAME) */
+static L4_Word_t free_blocks[FRAME_MAX_ORDER+1];	/**< Number of free blocks of each order */
+static L4_Word_t* free_next = NULL;				/**< Frame indexed, next block in the free list */
+static L4_Word_t* free_prev = NULL;				/**< Frame indexed, previous block in the free list */
+static uint8_t* block_order = NULL;				/**< Frame indexed, order of the free block starting here (or NOT_FREE_BLOCK) */
+static L4_Word_t buddy_count = 0;				/**< Number of frames in the buddy allocator */
+
+core_map_entry* core_map = NULL;
+
+static frame_t zero_pool[ZERO_POOL_SIZE]; /**< Stack of frames which are already zeroed */
+static L4_Word_t zero_count = 0; /**< Holds the current number of zeroed frames */
+static L4_Word_t zero_hits = 0; /**< Allocations served from the zero pool */
+static L4_Word_t zero_misses = 0; /**< Allocations which had to zero the frame themselves */
+
 
 /**
  * Pushes a frame on the stack.
@@ -63,6 +134,144 @@ static L4_Word_t frame_stack_remove(void) {
 	return (frame_stack_start+(--stack_count))->address;
 }
 
+
+/**
+ * Inserts a block at the head of the free list of its order.
+ *
+ * @param index frame index of the first frame of the block
+ * @param order order of the block
+ */
+static void free_list_add(L4_Word_t index, int order) {
+	block_order[index] = order;
+	free_prev[index] = NO_FRAME;
+	free_next[index] = free_head[order];
+	if(free_head[order] != NO_FRAME)
+		free_prev[free_head[order]] = index;
+	free_head[order] = index;
+	free_blocks[order]++;
+}
+
+
+/**
+ * Removes a block from the free list of its order.
+ *
+ * @param index frame index of the first frame of the block
+ */
+static void free_list_remove(L4_Word_t index) {
+	int order = block_order[index];
+	assert(order != NOT_FREE_BLOCK);
+
+	if(free_prev[index] != NO_FRAME)
+		free_next[free_prev[index]] = free_next[index];
+	else
+		free_head[order] = free_next[index];
+
+	if(free_next[index] != NO_FRAME)
+		free_prev[free_next[index]] = free_prev[index];
+
+	block_order[index] = NOT_FREE_BLOCK;
+	free_blocks[order]--;
+}
+
+
+/**
+ * Returns the frame index of the buddy of a block. Blocks are aligned
+ * to their size in physical memory, not relative to the first frame.
+ *
+ * @param index frame index of the block
+ * @param order order of the block
+ * @return frame index of the buddy or NO_FRAME if it lies outside of
+ * the frame table
+ */
+static L4_Word_t buddy_of(L4_Word_t index, int order) {
+	L4_Word_t buddy = (start + index*PAGESIZE) ^ (PAGESIZE << order);
+
+	if(buddy < start || buddy + (PAGESIZE << order) > end)
+		return NO_FRAME;
+
+	return (buddy - start) / PAGESIZE;
+}
+
+
+/**
+ * Gives a block back to the buddy allocator and merges it with its
+ * buddy as long as possible.
+ *
+ * @param index frame index of the block
+ * @param order order of the block
+ */
+static void buddy_free(L4_Word_t index, int order) {
+	buddy_count += 1UL << order;
+
+	while(order < FRAME_MAX_ORDER) {
+		L4_Word_t buddy = buddy_of(index, order);
+		if(buddy == NO_FRAME || block_order[buddy] != order)
+			break;
+
+		free_list_remove(buddy);
+		index = min(index, buddy);
+		order++;
+	}
+
+	free_list_add(index, order);
+}
+
+
+/**
+ * Takes a block of a given order out of the buddy allocator. Larger
+ * blocks are split, the unused halves go back to their free lists.
+ *
+ * @param order order of the block
+ * @return frame index of the block or NO_FRAME if there is no block
+ * of this order or larger
+ */
+static L4_Word_t buddy_alloc(int order) {
+	int found = order;
+	while(found <= FRAME_MAX_ORDER && free_head[found] == NO_FRAME)
+		found++;
+
+	if(found > FRAME_MAX_ORDER)
+		return NO_FRAME;
+
+	L4_Word_t index = free_head[found];
+	free_list_remove(index);
+
+	// the upper halves are free
+	while(found > order) {
+		found--;
+		free_list_add(index + (1UL << found), found);
+	}
+
+	buddy_count -= 1UL << order;
+	return index;
+}
+
+
+/**
+ * Moves all frames of the stack into the buddy allocator so they can
+ * be merged into larger blocks.
+ */
+static void frame_stack_drain(void) {
+	while(stack_count > 0)
+		buddy_free(frame_number(frame_stack_remove()), 0);
+}
+
+
+/**
+ * Returns a free single frame from the stack or the buddy allocator
+ * (not from the zero pool).
+ *
+ * @return frame or NULL if there is none
+ */
+static L4_Word_t frame_take_free(void) {
+	if(stack_count >= 1)
+		return frame_stack_remove();
+
+	L4_Word_t index = buddy_alloc(0);
+	return (index == NO_FRAME) ? (L4_Word_t) NULL : frame_address(index);
+}
+
+
 /**
  * Checks if the given parameter `frame` is within the memory range and
  * if the address is always at the start of a given frame.
@@ -156,7 +365,7 @@ void frame_init(L4_Word_t low, L4_Word_t high) {
 	assert(memsize % PAGESIZE == 0); // our code is based on that assumption
 
 	L4_Word_t frame_count = memsize / PAGESIZE;
-	L4_Word_t frame_table_size = frame_count * sizeof(frame_t);
+	L4_Word_t frame_table_size = FRAME_STACK_SIZE * sizeof(frame_t);
 	L4_Word_t bit_field_size = (frame_count / 8) + 1;
 
 	dprintf(2, "Physical Memory starts at address: %d\n", start);
@@ -171,62 +380,267 @@ void frame_init(L4_Word_t low, L4_Word_t high) {
 	assert(frame_stack_start != NULL);
 	stack_count = 0;
 
+	free_next = (L4_Word_t*) malloc(frame_count * sizeof(L4_Word_t)); // this is never freed but it's ok
+	free_prev = (L4_Word_t*) malloc(frame_count * sizeof(L4_Word_t)); // this is never freed but it's ok
+	block_order = (uint8_t*) malloc(frame_count); // this is never freed but it's ok
+	assert(free_next != NULL && free_prev != NULL && block_order != NULL);
+	memset(block_order, NOT_FREE_BLOCK, frame_count);
+	for(int order=0; order<=FRAME_MAX_ORDER; order++) {
+		free_head[order] = NO_FRAME;
+		free_blocks[order] = 0;
+	}
+
 	//bitfield_start = (char*) (frame_stack_start + frame_table_size);
 	bitfield_start = (char*) malloc(bit_field_size); // this is never freed but it's ok
 	assert(bitfield_start != NULL);
+	memset(bitfield_start, 0xFF, bit_field_size);
+
+	core_map = (core_map_entry*) malloc(frame_count * sizeof(core_map_entry)); // this is never freed but it's ok
+	assert(core_map != NULL);
+	memset(core_map, 0, frame_count * sizeof(core_map_entry));
+	dprintf(2, "Core Map Size: %d bytes\n", frame_count * sizeof(core_map_entry));
 
 	dprintf(2, "Physical Frames will start at address: %d\n", start);
 
-	L4_Word_t frame_iter;
-	// for better debugging we add the frames in reverse order on the stack
-	// so calls to frame_alloc will return with the first frames first
-	for(frame_iter = end-PAGESIZE; frame_iter >= start; frame_iter -= PAGESIZE) {
-		frame_stack_add(frame_iter);
-		bitfield_set(frame_iter, 0);
+	#ifdef SWAP_TEST
+	frame_count = min(frame_count, SWAP_FRAMES_LIMIT);
+	dprintf(0, "WARNING: running with artificially decreased frame number: %d\n", frame_count);
+	#endif
+
+	// freeing every frame merges them into the largest possible blocks
+	for(L4_Word_t i=0; i<frame_count; i++) {
+		bitfield_set(frame_address(i), 0);
+		buddy_free(i, 0);
 	}
 
-	dprintf(2, "Stack count now is: %d\n", stack_count);
+	dprintf(2, "Buddy allocator holds %d frames\n", buddy_count);
+}
 
-	#ifdef SWAP_TEST
-	stack_count = SWAP_FRAMES_LIMIT;
-	dprintf(0, "WARNING: running with artificially decreased frame number: %d\n", stack_count);
-	#endif
+
+/**
+ * Resets the core map entry of a frame.
+ *
+ * @param frame start address of the frame
+ */
+static void core_map_reset(L4_Word_t frame) {
+	core_map_entry* entry = frame_entry(frame);
+
+	memset(entry, 0, sizeof(core_map_entry));
+	entry->tid = L4_nilthread;
+	entry->swap_offset = -1;
 }
 
 
 /**
  * Allocates a frame (PAGESIZE bytes) in physical memory.
- * The top element is removed from the stack and the corresponding
- * bit in the bit field is set to 1.
+ * The top element is removed from the zero pool (or the stack if
+ * the pool is empty, or the buddy allocator if the stack is empty
+ * as well) and the corresponding bit in the bit field
+ * is set to 1. The core map entry of the frame is reset.
  *
  * @return start address of the frame or NULL in case there are no more frames left
  */
 L4_Word_t frame_alloc(void) {
-	if(stack_count >= 1) {
-		L4_Word_t frame = frame_stack_remove();
+	if(zero_count >= 1) {
+		L4_Word_t frame = zero_pool[--zero_count].address;
 		bitfield_set(frame, 1);
-		memset((void*)frame, 0, PAGESIZE); // make sure we don't leak data to other processes
+		core_map_reset(frame);
+		zero_hits++;
 		return frame;
 	}
-	else {
+
+	L4_Word_t frame = frame_take_free();
+	if(frame == (L4_Word_t) NULL) {
 		dprintf(1, "WARNING: %s: Ran out of physical memory :-(.\n", __FUNCTION__);
 		return (L4_Word_t) NULL;
 	}
 
+	bitfield_set(frame, 1);
+	core_map_reset(frame);
+	memset((void*)frame, 0, PAGESIZE); // make sure we don't leak data to other processes
+	frame_cache_flush(frame);
+	zero_misses++;
+	return frame;
 }
 
+
+/**
+ * Allocates 2^order physically contiguous frames which are aligned
+ * to their size. The frames are zeroed and their core map entries
+ * reset, afterwards they are independent frames which are freed one
+ * by one with frame_free (or all at once with frame_free_run).
+ *
+ * @param order log2 of the number of frames (at most FRAME_MAX_ORDER)
+ * @return start address of the run or NULL if physical memory is
+ * too fragmented
+ */
+L4_Word_t frame_alloc_run(int order) {
+	assert(order >= 0 && order <= FRAME_MAX_ORDER);
+
+	L4_Word_t index = buddy_alloc(order);
+	if(index == NO_FRAME && stack_count > 0) {
+		// frames on the stack may complete a block
+		frame_stack_drain();
+		index = buddy_alloc(order);
+	}
+
+	if(index == NO_FRAME)
+		return (L4_Word_t) NULL;
+
+	L4_Word_t base = frame_address(index);
+	L4_Word_t size = PAGESIZE << order;
+
+	for(L4_Word_t frame = base; frame < base + size; frame += PAGESIZE) {
+		bitfield_set(frame, 1);
+		core_map_reset(frame);
+	}
+
+	memset((void*)base, 0, size);
+	L4_CacheFlushRange(root_thread_g, base, base+size);
+
+	return base;
+}
+
+
+/**
+ * Allocates PAGES_PER_LARGE_PAGE physically contiguous frames which
+ * are aligned to LARGE_PAGESIZE (see frame_alloc_run).
+ *
+ * @return start address of the run or NULL if physical memory is
+ * too fragmented
+ */
+L4_Word_t frame_alloc_large(void) {
+	return frame_alloc_run(LARGE_PAGE_ORDER);
+}
+
+
+/**
+ * Returns the number of frames currently available
+ * (stack, zero pool and buddy allocator).
+ *
+ * @return number of free frames
+ */
+L4_Word_t frame_count_free(void) {
+	return stack_count + zero_count + buddy_count;
+}
+
+
+/**
+ * Checks if there are free frames which could be moved
+ * to the zero pool.
+ *
+ * @return TRUE if frame_zero_idle has work to do
+ */
+L4_Bool_t frame_zero_needed(void) {
+	return zero_count < ZERO_POOL_SIZE && stack_count + buddy_count >= 1;
+}
+
+
+/**
+ * Zeroes one free frame and moves it into the zero pool.
+ * This is meant to be called while the root server is idle.
+ */
+void frame_zero_idle(void) {
+	if(!frame_zero_needed())
+		return;
+
+	L4_Word_t frame = frame_take_free();
+	memset((void*)frame, 0, PAGESIZE);
+	frame_cache_flush(frame);
+	zero_pool[zero_count++].address = frame;
+}
+
+
+/**
+ * Returns how many allocations were served by the zero pool
+ * and how many had to zero a frame themselves.
+ *
+ * @param hits allocations served from the pool
+ * @param misses allocations which found the pool empty
+ */
+void frame_zero_stats(L4_Word_t* hits, L4_Word_t* misses) {
+	*hits = zero_hits;
+	*misses = zero_misses;
+}
+
+
+/**
+ * Returns the total number of frames managed by the frame table.
+ *
+ * @return number of frames
+ */
+L4_Word_t frame_count(void) {
+	return (end - start) / PAGESIZE;
+}
+
+
+/**
+ * Converts a frame address into its index in the frame table.
+ * This can be used to maintain frame indexed arrays.
+ *
+ * @param frame start address of the frame
+ * @return index of the frame (0 for the first frame)
+ */
+L4_Word_t frame_number(L4_Word_t frame) {
+	assert(is_valid_frame_address(frame));
+	return (frame - start) / PAGESIZE;
+}
+
+
+/**
+ * Converts a frame index back into the start address of the frame.
+ *
+ * @param number index of the frame (0 for the first frame)
+ * @return start address of the frame
+ */
+L4_Word_t frame_address(L4_Word_t number) {
+	assert(number < frame_count());
+	return start + number*PAGESIZE;
+}
+
+
+/**
+ * Returns the core map entry of a frame.
+ *
+ * @param frame start address of the frame
+ * @return pointer to the core map entry
+ */
+core_map_entry* frame_entry(L4_Word_t frame) {
+	return &core_map[frame_number(frame)];
+}
+
+
+/**
+ * Cleans and invalidates the cache lines the root server holds for
+ * a frame. This is needed after the root server wrote to a frame which
+ * is mapped by a user (so the data reaches memory) and before it reads
+ * a frame a user has written to (so no stale lines are used).
+ *
+ * @param frame start address of the frame
+ */
+void frame_cache_flush(L4_Word_t frame) {
+	assert(is_valid_frame_address(frame));
+	L4_CacheFlushRange(root_thread_g, frame, frame+PAGESIZE);
+}
+
+
 /**
  * Frees a previously allocated frame.
- * Frame is pushed on the stack and the corresponding bit in the bit field is
+ * Frame is pushed on the stack (or given back to the buddy allocator
+ * if the stack is full) and the corresponding bit in the bit field is
  * set to 0.
  *
  * @param frame start address of frame to be freed
  */
 void frame_free(L4_Word_t frame) {
 	assert(is_valid_frame_address(frame));
+	assert(!(frame_entry(frame)->flags & FRAME_SWAPPING)); // IO is still using the frame
 
 	if(bitfield_get(frame)) {
-		frame_stack_add(frame);
+		if(stack_count < FRAME_STACK_SIZE)
+			frame_stack_add(frame);
+		else
+			buddy_free(frame_number(frame), 0);
 		bitfield_set(frame, 0);
 	}
 	else {
@@ -234,3 +648,61 @@ void frame_free(L4_Word_t frame) {
 	}
 }
 
+
+/**
+ * Frees a run of frames allocated with frame_alloc_run at once.
+ *
+ * @param base start address of the run
+ * @param order order the run was allocated with
+ */
+void frame_free_run(L4_Word_t base, int order) {
+	assert(is_valid_frame_address(base));
+	assert(order >= 0 && order <= FRAME_MAX_ORDER);
+	assert((base & ((PAGESIZE << order) - 1)) == 0);
+
+	for(L4_Word_t frame = base; frame < base + (PAGESIZE << order); frame += PAGESIZE) {
+		assert(bitfield_get(frame));
+		assert(!(frame_entry(frame)->flags & FRAME_SWAPPING));
+		bitfield_set(frame, 0);
+	}
+
+	buddy_free(frame_number(base), order);
+}
+
+
+/**
+ * Computes how much of the free memory can't be used for a run of a
+ * given order, i.e. the share of free frames which lie in smaller
+ * blocks. Frames on the stack and in the zero pool count as blocks
+ * of order 0.
+ *
+ * @param order order of the run
+ * @return percentage of free frames which are unusable (0 if nothing is free)
+ */
+L4_Word_t frame_fragmentation(int order) {
+	L4_Word_t free = frame_count_free();
+	L4_Word_t usable = 0;
+
+	if(free == 0)
+		return 0;
+
+	for(int i=order; i<=FRAME_MAX_ORDER; i++)
+		usable += free_blocks[i] << i;
+
+	return (free - usable) * 100 / free;
+}
+
+
+/**
+ * Returns the order of the largest free block in the buddy allocator.
+ *
+ * @return order or -1 if the buddy allocator is empty
+ */
+int frame_largest_free_order(void) {
+	for(int order=FRAME_MAX_ORDER; order>=0; order--) {
+		if(free_blocks[order] > 0)
+			return order;
+	}
+
+	return -1;
+}
@@ -2,10 +2,70 @@
 #define _FRAMES_H
 
 #include <l4/types.h>
+#include "../queue.h"
+
+struct swap_cluster;
+
+/** Size of a large page (ARM large pages are 64 KB) */
+#define LARGE_PAGESIZE_LOG2 16
+#define LARGE_PAGESIZE (1UL << LARGE_PAGESIZE_LOG2)
+#define PAGES_PER_LARGE_PAGE (LARGE_PAGESIZE / PAGESIZE)
+/** Order of the buddy block which makes up a large page */
+#define LARGE_PAGE_ORDER (LARGE_PAGESIZE_LOG2 - PAGESIZE_LOG2)
+
+/** Largest run of frames (2^order) frame_alloc_run hands out */
+#define FRAME_MAX_ORDER 8
+
+// State bits of a core map entry
+#define FRAME_TRACKED		0x01	/**< Page is resident and in the clock (may be evicted) */
+#define FRAME_REFERENCED	0x02	/**< Page is mapped in the L4 page table (emulated reference bit) */
+#define FRAME_DIRTY			0x04	/**< Page differs from its copy in the swap file (or has none) */
+#define FRAME_PINNED		0x08	/**< Page must never be evicted (e.g. IPC memory) */
+#define FRAME_SWAPPING		0x10	/**< Page is currently read from or written to the swap file */
+#define FRAME_DELETED		0x20	/**< Owner went away during swapping, free the frame once IO is done */
+#define FRAME_LARGE			0x40	/**< Page is part of a page mapped as one large fpage */
+#define FRAME_TEXT			0x80	/**< Page is in the text cache of its executable (see loader.c) */
+#define FRAME_SHARED		0x100	/**< Page is mapped by more than one process (never evicted, see swap_share) */
+#define FRAME_SPECULATIVE	0x200	/**< Page is mapped by fault-around but not known to be referenced (see pager.c) */
+#define FRAME_PREFETCH		0x400	/**< Page is read ahead and was not faulted on since (see pager.c) */
+#define FRAME_HEAP			0x800	/**< Frame belongs to the heap of the root server (see heap.c) */
+
+/** Core map entry, describes the page living in a physical frame */
+typedef struct cme {
+	TAILQ_ENTRY(cme) entries;		/**< Links the page into the list of pages currently being swapped */
+
+	L4_ThreadId_t tid;				/**< Owner of the page (nilthread if the frame is not used for a user page) */
+	L4_Word_t virtual_address;		/**< Virtual address of the page in the address space of the owner */
+	int swap_offset;				/**< Copy of the page in the swap file, -1 if there is none */
+
+	L4_Word_t flags;				/**< FRAME_* state bits */
+	int to_swap;					/**< Page offset of the pending read when loading (see loader.c) */
+	struct swap_cluster* cluster;	/**< Write cluster the page is swapped out with (NULL if not swapping out) */
+	int users;						/**< Number of processes mapping the page (only used for FRAME_SHARED) */
+	L4_Word_t read_start;			/**< Time a swap in was started (us, lower bits only) */
+} core_map_entry;
+
+/** Frame indexed array of core map entries (frame_count() elements) */
+extern core_map_entry* core_map;
 
 void frame_init(L4_Word_t low, L4_Word_t high);
 L4_Word_t frame_alloc(void);
+L4_Word_t frame_alloc_large(void);
+L4_Word_t frame_alloc_run(int order);
 void frame_free(L4_Word_t frame);
+void frame_free_run(L4_Word_t base, int order);
+L4_Word_t frame_fragmentation(int order);
+int frame_largest_free_order(void);
+L4_Word_t frame_count_free(void);
+L4_Word_t frame_count(void);
+L4_Word_t frame_number(L4_Word_t frame);
+L4_Word_t frame_address(L4_Word_t number);
+core_map_entry* frame_entry(L4_Word_t frame);
+void frame_cache_flush(L4_Word_t frame);
+
+L4_Bool_t frame_zero_needed(void);
+void frame_zero_idle(void);
+void frame_zero_stats(L4_Word_t* hits, L4_Word_t* misses);
 
 //void print_bitfield(L4_Word_t start, L4_Word_t end);
 
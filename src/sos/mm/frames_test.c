@@ -1,6 +1,10 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sos_shared.h>
+#include <clock.h>
+
+#include "../libsos.h"
 
 #include "frames.h"
 #include "frames_test.h"
@@ -88,3 +92,83 @@ void frame_test4(void) {
 		//print_bitfield(0, 10);
 	}
 }
+
+/* Allocate a large frame run, check that it is aligned and
+   free its frames one by one */
+void frame_test5(void) {
+	L4_Word_t base = frame_alloc_large();
+	assert(base != 0);
+	assert(base % LARGE_PAGESIZE == 0);
+
+	for (L4_Word_t frame = base; frame < base + LARGE_PAGESIZE; frame += 4096) {
+		assert(*(L4_Word_t*) frame == 0);
+		frame_free(frame);
+	}
+
+	printf("Large frame run allocated at %p\n", (void*) base);
+}
+
+/* Allocate runs of every order, free them again and check that
+   the buddies coalesce back into the largest free block */
+void frame_test6(void) {
+	L4_Word_t runs[FRAME_MAX_ORDER+1];
+	int largest = frame_largest_free_order();
+
+	for (int order = 0; order <= FRAME_MAX_ORDER; order++) {
+		runs[order] = frame_alloc_run(order);
+		assert(runs[order] != 0);
+		assert(runs[order] % (PAGESIZE << order) == 0);
+	}
+
+	for (int order = 0; order <= FRAME_MAX_ORDER; order++)
+		frame_free_run(runs[order], order);
+
+	assert(frame_largest_free_order() == largest);
+	printf("Largest free run 2^%d frames, %lu%% fragmented\n", largest, frame_fragmentation(LARGE_PAGE_ORDER));
+}
+
+
+/** Number of alloc/free pairs per benchmark round */
+#define BENCH_ROUNDS 10000
+/** Number of frames held at once, spreads the frees over the table */
+#define BENCH_BATCH 32
+
+/**
+ * Runs BENCH_ROUNDS alloc/free pairs of runs of a given order,
+ * either through the single frame stack (order -1) or directly
+ * through the buddy allocator.
+ *
+ * @param order run order or -1 for frame_alloc/frame_free
+ * @return time taken in microseconds
+ */
+static timestamp_t bench_round(int order) {
+	L4_Word_t held[BENCH_BATCH];
+	timestamp_t start = get_time_stamp();
+
+	for (int i = 0; i < BENCH_ROUNDS; i += BENCH_BATCH) {
+		for (int j = 0; j < BENCH_BATCH; j++) {
+			held[j] = (order < 0) ? frame_alloc() : frame_alloc_run(order);
+			assert(held[j] != 0);
+		}
+		for (int j = 0; j < BENCH_BATCH; j++) {
+			if (order < 0)
+				frame_free(held[j]);
+			else
+				frame_free_run(held[j], order);
+		}
+	}
+
+	return get_time_stamp() - start;
+}
+
+/* Compare alloc/free throughput of the single frame stack with
+   the buddy allocator for single frames and for runs */
+void frame_bench(void) {
+	timestamp_t stack = bench_round(-1);
+	timestamp_t buddy = bench_round(0);
+	timestamp_t runs = bench_round(LARGE_PAGE_ORDER);
+
+	printf("%d alloc/free pairs: stack %llu us, buddy order 0 %llu us, large runs %llu us\n",
+			BENCH_ROUNDS, stack, buddy, runs);
+	printf("Largest free run 2^%d frames, %lu%% fragmented\n", frame_largest_free_order(), frame_fragmentation(LARGE_PAGE_ORDER));
+}
@@ -6,6 +6,9 @@ void frame_test1(void);
 void frame_test2(void);
 void frame_test3(void);
 void frame_test4(void);
+void frame_test5(void);
+void frame_test6(void);
+void frame_bench(void);
 
 
 #endif // _FRAMES_TEST_H
@@ -0,0 +1,211 @@
+/**
+ * Root Server Heap
+ * =============
+ * The malloc of the root server (K&R malloc of libc) starts with a
+ * small static area (HEAP_INITIAL_SIZE in main.c) which holds the
+ * frame table. Once that is used up, morecore (libc sys-l4_rootserver)
+ * calls heap_grow which takes a run of frames from the frame table.
+ * So page tables and other metadata use as much physical memory as
+ * they actually need instead of a fixed share decided at compile time.
+ *
+ * Growing
+ * ------------------------------
+ * The heap grows by runs of HEAP_GROW_ORDER (64 KB, the chunk size of
+ * morecore). If memory is too fragmented for that, smaller runs down
+ * to the size malloc needs are tried. Frames of the heap are marked
+ * with FRAME_HEAP in the core map, the pager never touches them.
+ * The heap never holds more than HEAP_MAX_PERCENT of all frames (its
+ * high-water mark), so a runaway server can't starve user processes.
+ * Taking frames for the heap lowers the number of free frames like
+ * any other allocation, so the page-out daemon makes room afterwards
+ * if the heap grew below the low watermark.
+ *
+ * Shrinking
+ * ------------------------------
+ * Memory freed with free() only goes back to the free list of malloc.
+ * heap_trim walks that list and gives every heap frame which lies
+ * completely within a free block back to the frame table, the rest
+ * of the block stays in the list. The page-out daemon calls it before
+ * it evicts user pages, as releasing an unused heap frame is much
+ * cheaper than a swap out.
+ */
+
+#include <assert.h>
+#include <sos_shared.h>
+
+#include "../libsos.h"
+#include "../../libs/c/src/k_r_malloc.h"
+#include "heap.h"
+#include "pager.h"
+#include "frames.h"
+
+#define verbose 1
+
+/** Order of the runs the heap normally grows by */
+#define HEAP_GROW_ORDER LARGE_PAGE_ORDER
+/** Share of all frames the heap may use at most (in percent) */
+#define HEAP_MAX_PERCENT 50
+
+/** Free list of the K&R malloc (see libs/c/src/malloc.c) */
+extern Header* _kr_malloc_freep;
+
+static L4_Word_t frames_used = 0;	/**< Frames currently owned by the heap */
+
+
+/**
+ * Checks if a page belongs to a frame the heap got with heap_grow.
+ *
+ * @param page page aligned address
+ * @return TRUE if the frame can be given back by heap_trim
+ */
+static L4_Bool_t is_heap_frame(L4_Word_t page) {
+	if(frame_count() == 0)
+		return FALSE;
+
+	L4_Word_t first = frame_address(0);
+	if(page < first || page >= first + frame_count()*PAGESIZE)
+		return FALSE; // e.g. the initial heap
+
+	return (frame_entry(page)->flags & FRAME_HEAP) != 0;
+}
+
+
+/**
+ * Puts a piece of a free block back into the free list of malloc.
+ *
+ * @param prev block the piece is linked behind
+ * @param start first address of the piece
+ * @param end end of the piece (exclusive)
+ * @return the new block
+ */
+static Header* link_piece(Header* prev, L4_Word_t start, L4_Word_t end) {
+	Header* piece = (Header*) start;
+
+	piece->s.size = (end - start) / sizeof(Header);
+	prev->s.ptr = piece;
+
+	return piece;
+}
+
+
+/**
+ * Takes frames from the frame table for malloc (called by morecore
+ * once the initial heap is used up).
+ *
+ * @param min_size number of bytes malloc needs at least
+ * @param size set to the number of bytes returned
+ * @return start of the new memory or NULL if there are not enough
+ * free frames or the heap reached its limit
+ */
+void* heap_grow(uintptr_t min_size, uintptr_t* size) {
+	int min_order = 0;
+	while((PAGESIZE << min_order) < min_size)
+		min_order++;
+
+	L4_Word_t limit = frame_count() * HEAP_MAX_PERCENT / 100;
+	L4_Word_t base = 0;
+	int order;
+
+	for(order = max(HEAP_GROW_ORDER, min_order); order >= min_order && order <= FRAME_MAX_ORDER; order--) {
+		if(frames_used + (1 << order) > limit)
+			continue;
+
+		if((base = frame_alloc_run(order)) != 0)
+			break;
+	}
+
+	if(base == 0) {
+		dprintf(0, "%s: no memory for %d bytes (heap has %d frames)\n", __FUNCTION__, min_size, frames_used);
+		vm_stats.heap_grow_failures++;
+		return NULL;
+	}
+
+	for(L4_Word_t frame = base; frame < base + (PAGESIZE << order); frame += PAGESIZE)
+		frame_entry(frame)->flags |= FRAME_HEAP;
+
+	frames_used += 1 << order;
+	vm_stats.heap_grows++;
+	vm_stats.heap_frames = frames_used;
+	vm_stats.heap_peak_frames = max(vm_stats.heap_peak_frames, frames_used);
+
+	dprintf(1, "%s: heap grows by %d frames to %d frames\n", __FUNCTION__, 1 << order, frames_used);
+
+	*size = PAGESIZE << order;
+	return (void*) base;
+}
+
+
+/**
+ * Gives all heap frames which are completely free back to the
+ * frame table.
+ *
+ * @return number of frames released
+ */
+L4_Word_t heap_trim(void) {
+	if(_kr_malloc_freep == NULL)
+		return 0;
+
+	// the list is circular and changes on the way, so count the blocks first
+	int blocks = 0;
+	Header* p = _kr_malloc_freep;
+	do {
+		blocks++;
+		p = p->s.ptr;
+	} while(p != _kr_malloc_freep);
+
+	L4_Word_t released = 0;
+	Header* prev = _kr_malloc_freep;
+
+	for(int i=0; i<blocks; i++) {
+		Header* block = prev->s.ptr;
+		Header* next = block->s.ptr;
+		L4_Word_t start = (L4_Word_t) block;
+		L4_Word_t end = start + block->s.size * sizeof(Header);
+
+		// cut out every heap frame within the block
+		Header* last = prev;
+		L4_Word_t piece = start;
+		for(L4_Word_t page = (start + PAGESIZE - 1) & ~(PAGESIZE - 1); page + PAGESIZE <= end; page += PAGESIZE) {
+			if(!is_heap_frame(page))
+				continue;
+
+			if(page > piece)
+				last = link_piece(last, piece, page);
+
+			frame_entry(page)->flags &= ~FRAME_HEAP;
+			frame_free(page);
+			released++;
+			piece = page + PAGESIZE;
+		}
+
+		if(piece == start) {
+			prev = block; // nothing released
+			continue;
+		}
+
+		if(end > piece)
+			last = link_piece(last, piece, end);
+		last->s.ptr = next;
+
+		if(_kr_malloc_freep == block)
+			_kr_malloc_freep = prev;
+		prev = last;
+	}
+
+	frames_used -= released;
+	vm_stats.heap_frames = frames_used;
+	vm_stats.heap_trimmed_frames += released;
+
+	if(released > 0)
+		dprintf(1, "%s: released %d frames, heap has %d frames\n", __FUNCTION__, released, frames_used);
+
+	return released;
+}
+
+
+/**
+ * @return number of frames currently owned by the heap
+ */
+L4_Word_t heap_frames(void) {
+	return frames_used;
+}
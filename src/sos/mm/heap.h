@@ -0,0 +1,11 @@
+#ifndef HEAP_H_
+#define HEAP_H_
+
+#include <stdint.h>
+#include <l4/types.h>
+
+void* heap_grow(uintptr_t min_size, uintptr_t* size);
+L4_Word_t heap_trim(void);
+L4_Word_t heap_frames(void);
+
+#endif /* HEAP_H_ */
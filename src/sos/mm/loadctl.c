@@ -0,0 +1,220 @@
+/**
+ * Load Control
+ * =============
+ * If the pages all running processes use at the moment don't fit
+ * into memory, every process faults all the time and waits for the
+ * swap file (thrashing). More swapping does not help in this case,
+ * only running fewer processes at a time does.
+ *
+ * Detection
+ * ------------------------------
+ * Every LOADCTL_INTERVAL microseconds (clock alarm) we look at the
+ * page faults since the last check and the number of pages which are
+ * read from or written to the swap file right now. If both are above
+ * their threshold for LOADCTL_THRASH_INTERVALS checks in a row (and
+ * we're below the low watermark of free frames) the system is
+ * considered to be thrashing.
+ *
+ * Suspending and Resuming
+ * ------------------------------
+ * While thrashing, the process with the most resident pages is
+ * suspended: its thread is halted and its pages lose their reference
+ * bits so the clock evicts them first (swap_dereference_all). At least
+ * one process is always left running. Once fault rate and swap IO
+ * stayed below half of their thresholds for LOADCTL_CALM_INTERVALS
+ * checks, the process which was suspended first is resumed. One
+ * process is suspended or resumed per check.
+ * Replies to a suspended thread (e.g. for a page which was swapped
+ * in) are still delivered, the thread just does not continue until
+ * it is resumed.
+ * Every decision is printed together with the numbers it was based on.
+ */
+
+#include <assert.h>
+#include <sos_shared.h>
+#include <clock.h>
+#include <l4/thread.h>
+
+#include "loadctl.h"
+#include "pager.h"
+#include "swapper.h"
+#include "frames.h"
+#include "../process.h"
+#include "../libsos.h"
+
+#define verbose 1
+
+/** Time between two checks in microseconds */
+#define LOADCTL_INTERVAL 100000
+/** Page faults per interval above which we might be thrashing */
+#define LOADCTL_FAULT_THRESHOLD 100
+/** Pages in swap IO above which we might be thrashing */
+#define LOADCTL_IO_THRESHOLD 8
+/** Intervals in a row with thrashing before a process is suspended */
+#define LOADCTL_THRASH_INTERVALS 3
+/** Calm intervals in a row before a process is resumed */
+#define LOADCTL_CALM_INTERVALS 10
+
+static L4_Word_t last_page_faults;		/**< Page fault count at the last check */
+static L4_Word_t thrash_intervals;		/**< Checks in a row which looked like thrashing */
+static L4_Word_t calm_intervals;		/**< Checks in a row without pressure */
+
+
+/**
+ * Halts the thread of a process and makes its pages the first
+ * ones the clock evicts.
+ *
+ * @param p process to suspend
+ */
+static void suspend(process* p) {
+	L4_Stop(p->tid);
+	p->suspended_since = get_time_stamp();
+	swap_dereference_all(p->tid);
+
+	vm_stats.loadctl_suspends++;
+}
+
+
+/**
+ * Lets the thread of a suspended process continue.
+ *
+ * @param p suspended process
+ */
+static void resume(process* p) {
+	L4_Word_t dummy;
+	L4_ThreadId_t dummy_id;
+
+	// no AbortIPC (like L4_Start), the thread may wait for a reply
+	(void) L4_ExchangeRegisters(p->tid, L4_ExReg_Resume, 0, 0, 0, 0, L4_nilthread,
+			&dummy, &dummy, &dummy, &dummy, &dummy, &dummy_id);
+	p->suspended_since = 0;
+
+	vm_stats.loadctl_resumes++;
+}
+
+
+/**
+ * Finds the running process with the most resident pages.
+ *
+ * @return process or NULL if less than two processes are running
+ */
+static process* suspend_candidate(void) {
+	process* largest = NULL;
+	int running = 0;
+
+	for(int i=1; i<MAX_RUNNING_PROCESS; i++) {
+		process* p = get_process(pid2tid(i));
+		if(!p->is_active || p->suspended_since != 0)
+			continue;
+
+		running++;
+		if(largest == NULL || p->resident > largest->resident)
+			largest = p;
+	}
+
+	return (running >= 2) ? largest : NULL;
+}
+
+
+/**
+ * Finds the process which is suspended the longest.
+ *
+ * @return process or NULL if no process is suspended
+ */
+static process* resume_candidate(void) {
+	process* oldest = NULL;
+
+	for(int i=1; i<MAX_RUNNING_PROCESS; i++) {
+		process* p = get_process(pid2tid(i));
+		if(!p->is_active || p->suspended_since == 0)
+			continue;
+
+		if(oldest == NULL || p->suspended_since < oldest->suspended_since)
+			oldest = p;
+	}
+
+	return oldest;
+}
+
+
+/**
+ * Alarm function called every LOADCTL_INTERVAL. Checks fault rate
+ * and swap IO and suspends or resumes a process if necessary.
+ *
+ * @param owner root thread (not used)
+ * @param status clock status
+ */
+static void loadctl_check(L4_ThreadId_t owner, int status) {
+	L4_Word_t faults = vm_stats.page_faults - last_page_faults;
+	L4_Word_t io = swap_io_pending();
+	last_page_faults = vm_stats.page_faults;
+
+	if(faults > LOADCTL_FAULT_THRESHOLD && io > LOADCTL_IO_THRESHOLD && pager_reclaim_needed()) {
+		calm_intervals = 0;
+
+		if(++thrash_intervals >= LOADCTL_THRASH_INTERVALS) {
+			thrash_intervals = 0;
+			process* p = suspend_candidate();
+
+			if(p != NULL) {
+				dprintf(0, "loadctl: suspend pid %d (%s, %d resident pages): %d faults in %d ms, %d pages in swap IO, %d free frames\n",
+						tid2pid(p->tid), p->command, p->resident, faults, LOADCTL_INTERVAL / 1000, io, frame_count_free());
+				suspend(p);
+			}
+			else {
+				dprintf(0, "loadctl: thrashing (%d faults in %d ms, %d pages in swap IO) but only one process is running\n",
+						faults, LOADCTL_INTERVAL / 1000, io);
+			}
+		}
+	}
+	else if(faults < LOADCTL_FAULT_THRESHOLD / 2 && io < LOADCTL_IO_THRESHOLD / 2) {
+		thrash_intervals = 0;
+
+		if(++calm_intervals >= LOADCTL_CALM_INTERVALS) {
+			calm_intervals = 0;
+			process* p = resume_candidate();
+
+			if(p != NULL) {
+				dprintf(0, "loadctl: resume pid %d (%s) after %d ms: %d faults in %d ms, %d pages in swap IO, %d free frames\n",
+						tid2pid(p->tid), p->command, (int) ((get_time_stamp() - p->suspended_since) / 1000),
+						faults, LOADCTL_INTERVAL / 1000, io, frame_count_free());
+				resume(p);
+			}
+		}
+	}
+	else {
+		thrash_intervals = 0;
+		calm_intervals = 0;
+	}
+
+	int ret = register_alarm(LOADCTL_INTERVAL, owner, &loadctl_check);
+	assert(ret == CLOCK_R_OK);
+}
+
+
+/**
+ * Starts the periodic checks. The clock driver needs to be started
+ * already.
+ */
+void loadctl_init(void) {
+	last_page_faults = vm_stats.page_faults;
+
+	int ret = register_alarm(LOADCTL_INTERVAL, root_thread_g, &loadctl_check);
+	assert(ret == CLOCK_R_OK);
+}
+
+
+/**
+ * Called when a process is deleted, a suspended process just isn't
+ * resumed anymore.
+ *
+ * @param tid thread ID of the deleted process
+ */
+void loadctl_forget(L4_ThreadId_t tid) {
+	process* p = get_process(tid);
+
+	if(p->suspended_since != 0)
+		dprintf(0, "loadctl: suspended pid %d (%s) was deleted\n", tid2pid(tid), p->command);
+
+	p->suspended_since = 0;
+}
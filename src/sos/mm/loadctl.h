@@ -0,0 +1,9 @@
+#ifndef LOADCTL_H_
+#define LOADCTL_H_
+
+#include <l4/types.h>
+
+void loadctl_init(void);
+void loadctl_forget(L4_ThreadId_t tid);
+
+#endif /* LOADCTL_H_ */
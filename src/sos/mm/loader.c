@@ -0,0 +1,471 @@
+/**
+ * ELF Loader
+ * =============
+ * Executables are loaded on demand straight from the file system.
+ * On process creation only the first LOADER_HEADER_SIZE bytes of the
+ * file are read. The program headers in there tell which parts of
+ * the file belong to which virtual addresses. These segments are
+ * stored in the process descriptor (see process.h) and the new
+ * thread is started right away at the entry point of the binary.
+ *
+ * Page-in
+ * ------------------------------
+ * The first time a text or data page with a file backed part is
+ * touched the pager allocates a (zeroed) frame for it and calls
+ * loader_page_in. This reads the file backed parts of the page
+ * from NFS, LOADER_READ_SIZE bytes per call, and restarts the
+ * thread once the page is complete. The remaining bytes of the
+ * page (BSS or gaps between segments) stay zero. Pages without
+ * any file backed part (e.g. the rest of the BSS) are handled by
+ * the pager like any other new page.
+ * While the page is read its frame is marked as swapping, so it
+ * is treated like a page which is swapped in (see swapper.c). Once
+ * loaded a data page is dirty and ends up in the swap file when it is
+ * evicted, as it may be written. Text pages are clean instead: when
+ * the clock evicts one its frame is simply freed and the next fault
+ * reads it from the file again (or shares it from the text cache).
+ *
+ * So the time to start a process and the memory it uses depend on
+ * the pages actually touched and not on the size of the binary.
+ *
+ * Text Cache
+ * ------------------------------
+ * Text pages are never written after they are loaded, so instances of
+ * the same executable can use the same frames. Every text page loaded
+ * from a file is entered in the text cache (a hash table keyed by the
+ * file_cache entry and the virtual address of the page) and marked
+ * with FRAME_TEXT. Before a text page is read from the file the pager
+ * asks the cache for it (loader_text_share). On a hit the frame is
+ * mapped read-only into the new process as well and becomes a shared
+ * frame (see swapper.c), which stays out of the clock until only one
+ * user is left. Frames are removed from the cache when they are freed
+ * or evicted and when the executable is written to (loader_file_changed).
+ *
+ **/
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sos_shared.h>
+#include <elf/elf.h>
+
+#include "../libsos.h"
+#include "../process.h"
+#include "loader.h"
+#include "frames.h"
+#include "pager.h"
+#include "swapper.h"
+#include "slab.h"
+
+#define verbose 1
+
+/** Bytes read on process creation, the program headers must lie within them */
+#define LOADER_HEADER_SIZE 512
+/** Maximum amount of bytes read from the executable per NFS call */
+#define LOADER_READ_SIZE 512
+
+/** Number of hash buckets of the text cache */
+#define TEXT_CACHE_BUCKETS 256
+#define TEXT_CACHE_HASH(addr) (((addr) >> PAGESIZE_LOG2) % TEXT_CACHE_BUCKETS)
+
+/** Text page loaded from an executable */
+typedef struct text_page {
+	file_info* file;			/**< Executable the page belongs to */
+	L4_Word_t addr;				/**< Virtual address of the page */
+	L4_Word_t frame;			/**< Frame holding the page */
+	struct text_page* next;		/**< Next entry in the same bucket */
+} text_page;
+
+/** Text cache, buckets are selected by the virtual address only so entries can be found by frame */
+static text_page* text_cache[TEXT_CACHE_BUCKETS];
+
+/** Object cache for the text cache entries (see slab.c) */
+static slab_cache text_page_cache = SLAB_CACHE_INITIALIZER("text page", text_page);
+
+/** State of a header read */
+typedef struct header_request {
+	file_info* file;
+	loader_callback callback;
+	uintptr_t token;
+} header_request;
+
+
+/**
+ * Fills in the image for an executable from its ELF header.
+ *
+ * @param header start of the ELF file
+ * @param size number of valid bytes in header
+ * @param image where to store the segments
+ * @return 0 on success, INVALID_EXECUTABLE or FILE_TOO_BIG if the file
+ * can't be loaded
+ */
+static int parse_header(void* header, int size, elf_image* image) {
+	struct Elf32_Header* elf_header = header;
+
+	if(size < (int)sizeof(struct Elf32_Header) || elf_checkFile(header) != 0)
+		return INVALID_EXECUTABLE;
+
+	int headers = elf_getNumProgramHeaders(header);
+	if(elf_header->e_phoff + headers * sizeof(struct Elf32_Phdr) > (unsigned)size) {
+		dprintf(0, "Program headers of %s are not within the first %d bytes.\n", image->file->filename, size);
+		return INVALID_EXECUTABLE;
+	}
+
+	image->entry = elf_getEntryPoint(header);
+	image->segment_count = 0;
+
+	for(int i=0; i<headers; i++) {
+		if(elf_getProgramHeaderType(header, i) != PT_LOAD)
+			continue;
+
+		if(image->segment_count == MAX_ELF_SEGMENTS)
+			return INVALID_EXECUTABLE;
+
+		elf_segment* segment = &image->segments[image->segment_count++];
+		segment->vaddr = elf_getProgramHeaderVaddr(header, i);
+		segment->mem_size = elf_getProgramHeaderMemorySize(header, i);
+		segment->file_size = elf_getProgramHeaderFileSize(header, i);
+		segment->offset = elf_getProgramHeaderOffset(header, i);
+
+		dprintf(1, "Segment %d of %s: vaddr:0x%X mem_size:%d file_size:%d offset:%d\n", i, image->file->filename,
+				segment->vaddr, segment->mem_size, segment->file_size, segment->offset);
+
+		if(segment->file_size > segment->mem_size || segment->offset + segment->file_size > image->file->status.st_size)
+			return INVALID_EXECUTABLE;
+
+		// segments need to fit into text and data region of the address space
+		if(segment->vaddr < TEXT_START || segment->vaddr + segment->mem_size > DATA_END)
+			return FILE_TOO_BIG;
+	}
+
+	return 0;
+}
+
+
+/**
+ * NFS callback for the header read. Parses the header and hands
+ * the result over to the callback of the requester.
+ */
+static void header_read_callback(uintptr_t token, int status, fattr_t *attr, int bytes_read, char *data) {
+	header_request* request = (header_request*) token;
+	elf_image image;
+	int ret = INVALID_EXECUTABLE;
+
+	image.file = request->file;
+
+	if(status == NFS_OK)
+		ret = parse_header(data, bytes_read, &image);
+	else
+		dprintf(0, "%s: Bad NFS status (%d) from callback.\n", __FUNCTION__, status);
+
+	request->callback(request->token, ret, &image);
+	free(request);
+}
+
+
+/**
+ * Reads and parses the header of an executable. The callback is
+ * called with status 0 and the image of the executable or an error
+ * code of process_create in case the file is not a loadable ELF binary.
+ *
+ * @param file executable
+ * @param callback called once the header is read
+ * @param token passed to the callback
+ */
+void loader_read_header(file_info* file, loader_callback callback, uintptr_t token) {
+	header_request* request = malloc(sizeof(header_request));
+	assert(request != NULL);
+
+	request->file = file;
+	request->callback = callback;
+	request->token = token;
+
+	nfs_read(&file->nfs_handle, 0, LOADER_HEADER_SIZE, &header_read_callback, (uintptr_t)request);
+}
+
+
+/**
+ * Finds the next part of a page which has to be read from the executable.
+ *
+ * @param image executable
+ * @param addr virtual address of the page
+ * @param from offset within the page to start searching at
+ * @param page_offset set to the offset of the part within the page
+ * @param file_offset set to the position of the part in the file
+ * @return number of bytes to read (at most LOADER_READ_SIZE), 0 if there
+ * is nothing left to read for this page
+ */
+static L4_Word_t next_chunk(elf_image* image, L4_Word_t addr, L4_Word_t from, L4_Word_t* page_offset, L4_Word_t* file_offset) {
+	L4_Word_t length = 0;
+	*page_offset = PAGESIZE;
+
+	for(int i=0; i<image->segment_count; i++) {
+		elf_segment* segment = &image->segments[i];
+		L4_Word_t start = max(segment->vaddr, addr + from);
+		L4_Word_t end = min(segment->vaddr + segment->file_size, addr + PAGESIZE);
+
+		if(start < end && start - addr < *page_offset) {
+			*page_offset = start - addr;
+			*file_offset = segment->offset + (start - segment->vaddr);
+			length = min(end - start, LOADER_READ_SIZE);
+		}
+	}
+
+	return length;
+}
+
+
+/**
+ * Checks if a range of virtual addresses contains bytes
+ * which have to be read from the executable.
+ *
+ * @param image executable
+ * @param addr start of the range
+ * @param size size of the range
+ * @return TRUE if some part of the range is backed by the file
+ */
+L4_Bool_t loader_is_file_backed(elf_image* image, L4_Word_t addr, L4_Word_t size) {
+
+	for(int i=0; i<image->segment_count; i++) {
+		elf_segment* segment = &image->segments[i];
+
+		if(segment->vaddr < addr + size && segment->vaddr + segment->file_size > addr)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+/**
+ * Looks up a page in the text cache.
+ *
+ * @param file executable
+ * @param addr virtual address of the page
+ * @return cache entry or NULL if the page is not cached
+ */
+static text_page* text_cache_lookup(file_info* file, L4_Word_t addr) {
+	text_page* entry;
+
+	for(entry = text_cache[TEXT_CACHE_HASH(addr)]; entry != NULL; entry = entry->next) {
+		if(entry->file == file && entry->addr == addr)
+			return entry;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Enters a freshly loaded text page in the text cache, unless another
+ * instance loaded the same page in the mean time (the page stays
+ * private then).
+ *
+ * @param file executable
+ * @param page core map entry of the page
+ */
+static void text_cache_insert(file_info* file, core_map_entry* page) {
+	if(text_cache_lookup(file, page->virtual_address) != NULL)
+		return;
+
+	text_page* entry = slab_alloc(&text_page_cache);
+	assert(entry != NULL);
+
+	entry->file = file;
+	entry->addr = page->virtual_address;
+	entry->frame = frame_address(page - core_map);
+	entry->next = text_cache[TEXT_CACHE_HASH(entry->addr)];
+	text_cache[TEXT_CACHE_HASH(entry->addr)] = entry;
+
+	page->flags |= FRAME_TEXT;
+}
+
+
+/**
+ * Returns the frame of a cached text page to map it into another
+ * process. The frame is shared (see swap_share).
+ *
+ * @param tid faulting thread
+ * @param addr virtual address of the page
+ * @return frame or 0 if the page has to be loaded from the file
+ */
+L4_Word_t loader_text_share(L4_ThreadId_t tid, L4_Word_t addr) {
+	file_info* file = get_process(tid)->image.file;
+	if(addr < TEXT_START || addr >= TEXT_END || file == NULL)
+		return 0;
+
+	text_page* entry = text_cache_lookup(file, addr);
+	if(entry == NULL)
+		return 0;
+
+	core_map_entry* page = frame_entry(entry->frame);
+	assert((page->flags & FRAME_TEXT) && !(page->flags & FRAME_LARGE));
+
+	// the only user is writing it to swap right now
+	if(page->flags & FRAME_SWAPPING)
+		return 0;
+
+	swap_share(entry->frame);
+	vm_stats.text_cache_hits++;
+
+	dprintf(2, "Sharing text page 0x%X of %s (frame 0x%X, %d users)\n", addr, file->filename, entry->frame, page->users);
+	return entry->frame;
+}
+
+
+/**
+ * Removes a text page from the cache. Called before its frame is
+ * freed.
+ *
+ * @param frame frame of the page
+ */
+void loader_text_remove(L4_Word_t frame) {
+	core_map_entry* page = frame_entry(frame);
+	text_page** entry = &text_cache[TEXT_CACHE_HASH(page->virtual_address)];
+
+	for(; *entry != NULL; entry = &(*entry)->next) {
+		if((*entry)->frame == frame) {
+			text_page* removed = *entry;
+			*entry = removed->next;
+			slab_free(removed);
+			page->flags &= ~FRAME_TEXT;
+			return;
+		}
+	}
+
+	assert(!"Text page not in cache");
+}
+
+
+/**
+ * Forgets all cached text pages of a file since its content changes.
+ * Processes which already use these pages keep them.
+ *
+ * @param file file which is written to
+ */
+void loader_file_changed(file_info* file) {
+
+	for(int i=0; i<TEXT_CACHE_BUCKETS; i++) {
+		text_page** entry = &text_cache[i];
+
+		while(*entry != NULL) {
+			if((*entry)->file == file) {
+				text_page* removed = *entry;
+				*entry = removed->next;
+				frame_entry(removed->frame)->flags &= ~FRAME_TEXT;
+				slab_free(removed);
+			}
+			else {
+				entry = &(*entry)->next;
+			}
+		}
+	}
+
+}
+
+
+static void page_read_callback(uintptr_t token, int status, fattr_t *attr, int bytes_read, char *data);
+
+
+/**
+ * Sends the read request for the next part of a page.
+ *
+ * @param page core map entry of the frame (to_swap holds the offset
+ * within the page where the read starts)
+ * @param file_offset position in the file
+ * @param length number of bytes
+ */
+static void read_chunk(core_map_entry* page, L4_Word_t file_offset, L4_Word_t length) {
+	vm_stats.exec_read_rpcs++;
+	nfs_read(&get_process(page->tid)->image.file->nfs_handle, file_offset, length, &page_read_callback, (uintptr_t)page);
+}
+
+
+/**
+ * NFS callback for page-ins. Copies the data into the frame and
+ * reads the next part of the page or restarts the faulting thread
+ * if the page is complete.
+ */
+static void page_read_callback(uintptr_t token, int status, fattr_t *attr, int bytes_read, char *data) {
+	core_map_entry* page = (core_map_entry*) token;
+	L4_Word_t frame = frame_address(page - core_map);
+
+	// owner is gone
+	if(page->flags & FRAME_DELETED) {
+		page->flags = 0;
+		frame_free(frame);
+		return;
+	}
+
+	if(status != NFS_OK) {
+		dprintf(0, "%s: Bad NFS status (%d) from callback.\n", __FUNCTION__, status);
+		assert(FALSE);
+		return;
+	}
+
+	elf_image* image = &get_process(page->tid)->image;
+	L4_Word_t page_offset, file_offset;
+	L4_Word_t length = next_chunk(image, page->virtual_address, page->to_swap, &page_offset, &file_offset);
+	assert(page_offset == page->to_swap && bytes_read <= length);
+
+	// a short read leaves the rest of the part zero filled
+	if(bytes_read < length)
+		dprintf(0, "%s: Read only %d of %d bytes at page 0x%X.\n", __FUNCTION__, bytes_read, length, page->virtual_address);
+	memcpy((char*)frame + page_offset, data, bytes_read);
+
+	length = next_chunk(image, page->virtual_address, page_offset + length, &page_offset, &file_offset);
+	if(length > 0) {
+		page->to_swap = page_offset;
+		read_chunk(page, file_offset, length);
+		return;
+	}
+
+	// page complete, it is new for the swapper
+	page->flags = 0;
+	frame_cache_flush(frame);
+	vm_stats.exec_page_ins++;
+
+	if(page->virtual_address < TEXT_END) {
+		swap_track_text(page->tid, page->virtual_address, frame);
+		text_cache_insert(image->file, page);
+	}
+	else {
+		swap_track(page->tid, page->virtual_address, frame);
+	}
+
+	send_ipc_reply(page->tid, L4_PAGEFAULT, 0);
+}
+
+
+/**
+ * Starts reading a page from the executable of a process. The
+ * faulting thread is restarted once the page is loaded. The frame
+ * must be zeroed and the page needs to have a file backed part
+ * (see loader_is_file_backed).
+ *
+ * @param tid faulting thread
+ * @param addr virtual address of the page
+ * @param frame frame for the page
+ * @return SWAPPING_PENDING
+ */
+int loader_page_in(L4_ThreadId_t tid, L4_Word_t addr, L4_Word_t frame) {
+	elf_image* image = &get_process(tid)->image;
+	core_map_entry* page = frame_entry(frame);
+	assert(page->flags == 0);
+
+	L4_Word_t page_offset, file_offset;
+	L4_Word_t length = next_chunk(image, addr, 0, &page_offset, &file_offset);
+	assert(length > 0);
+
+	page->tid = tid;
+	page->virtual_address = addr;
+	page->swap_offset = -1;
+	page->flags = FRAME_SWAPPING;
+	page->to_swap = page_offset;
+	page->cluster = NULL;
+
+	dprintf(2, "Loading page 0x%X of %s from file offset %d\n", addr, image->file->filename, file_offset);
+	read_chunk(page, file_offset, length);
+
+	return SWAPPING_PENDING;
+}
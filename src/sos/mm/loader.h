@@ -0,0 +1,37 @@
+#ifndef LOADER_H_
+#define LOADER_H_
+
+#include <l4/types.h>
+#include "../io/io.h"
+
+/** Maximum number of loadable segments of an executable */
+#define MAX_ELF_SEGMENTS 4
+
+/** Loadable segment of an executable */
+typedef struct elf_segment {
+	L4_Word_t vaddr;		/**< Virtual start address of the segment */
+	L4_Word_t mem_size;		/**< Size of the segment in memory */
+	L4_Word_t file_size;	/**< Bytes backed by the file (the rest up to mem_size is zero filled) */
+	L4_Word_t offset;		/**< Position of the segment in the file */
+} elf_segment;
+
+/** Describes where the text and data pages of a process come from */
+typedef struct elf_image {
+	file_info* file;							/**< Executable in the file cache */
+	L4_Word_t entry;							/**< Entry point */
+	int segment_count;							/**< Number of used entries in segments */
+	elf_segment segments[MAX_ELF_SEGMENTS];		/**< Loadable segments */
+} elf_image;
+
+/** Called once the header of an executable is parsed (image is only valid during the call) */
+typedef void (*loader_callback)(uintptr_t token, int status, elf_image* image);
+
+void loader_read_header(file_info* file, loader_callback callback, uintptr_t token);
+L4_Bool_t loader_is_file_backed(elf_image* image, L4_Word_t addr, L4_Word_t size);
+int loader_page_in(L4_ThreadId_t tid, L4_Word_t addr, L4_Word_t frame);
+
+L4_Word_t loader_text_share(L4_ThreadId_t tid, L4_Word_t addr);
+void loader_text_remove(L4_Word_t frame);
+void loader_file_changed(file_info* file);
+
+#endif /* LOADER_H_ */
@@ -0,0 +1,200 @@
+/**
+ * Same-Page Merging
+ * =============
+ * Processes started from the same executable (or cloned) often have
+ * heap and stack pages with the same contents, and many anonymous
+ * pages are zero again after they were used. A scanner running from
+ * a clock alarm looks for such pages and lets them share one frame,
+ * which frees frames before we have to swap.
+ *
+ * Scanning
+ * ------------------------------
+ * Every MERGE_INTERVAL microseconds the scanner looks at the next
+ * MERGE_PAGES_PER_SCAN entries of the core map, so the time it takes
+ * from the root server is bounded no matter how much memory is in use.
+ * Only pages in the clock which are not mapped right now are hashed
+ * (a mapped page could be written while we look at it). A page is only
+ * merged if its checksum did not change since the last time the
+ * scanner passed, pages which are written all the time would be copied
+ * again right away.
+ *
+ * Merging
+ * ------------------------------
+ * Anonymous pages which only contain zeros are replaced by the zero
+ * page (see pager.c) and their frame is freed. For all other pages the
+ * scanner remembers one frame per bucket, which is chosen by checksum
+ * and virtual address. If a page has the same checksum and virtual
+ * address as the frame in its bucket and the contents are equal, the
+ * page table entry is pointed to that frame which becomes shared copy
+ * on write (swap_share), the frame of the page is freed. Only pages at
+ * the same virtual address (of different processes) are merged: the
+ * core map keeps one address per frame, and swap_unshare finds the
+ * last user of a shared frame by looking up that address. A write
+ * to a merged page is handled like any other write to a shared page
+ * by the pager (copy_shared_page). Shared frames are not evicted by the
+ * clock, so merging only pays off for pages which stay resident anyway;
+ * the scanner therefore leaves pages alone until the clock has found
+ * them unreferenced once.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sos_shared.h>
+#include <clock.h>
+
+#include "../l4.h"
+#include "../libsos.h"
+#include "merge.h"
+#include "pager.h"
+#include "frames.h"
+
+#define verbose 1
+
+/** Time in microseconds between two scans */
+#define MERGE_INTERVAL 50000
+/** Number of core map entries looked at per scan */
+#define MERGE_PAGES_PER_SCAN 32
+/** Number of checksum buckets with a frame to merge with */
+#define MERGE_BUCKETS 512
+
+/** Frame a page with the same checksum can be merged with */
+typedef struct merge_candidate {
+	L4_Word_t frame;		/**< frame (0 if the bucket is empty) */
+	L4_Word_t checksum;		/**< checksum of the frame when it was put here */
+	L4_Word_t virtual_address;	/**< virtual address of the page in the frame */
+} merge_candidate;
+
+static merge_candidate candidates[MERGE_BUCKETS];
+static L4_Word_t* checksums = NULL;		/**< Checksum of every frame when the scanner passed it last */
+static L4_Word_t cursor = 0;			/**< Next core map entry to look at */
+
+
+/**
+ * Computes a checksum (FNV-1a over words) of a frame.
+ *
+ * @param frame frame to look at
+ * @param zero set to TRUE if the frame only contains zeros
+ * @return checksum
+ */
+static L4_Word_t frame_checksum(L4_Word_t frame, L4_Bool_t* zero) {
+	L4_Word_t* words = (L4_Word_t*) frame;
+	L4_Word_t checksum = 2166136261UL;
+	L4_Word_t bits = 0;
+
+	for(int i=0; i<PAGESIZE / sizeof(L4_Word_t); i++) {
+		checksum = (checksum ^ words[i]) * 16777619UL;
+		bits |= words[i];
+	}
+
+	*zero = (bits == 0);
+	return checksum;
+}
+
+
+/**
+ * Pages the scanner looks at: in the clock, not mapped, owned by a
+ * single process and not being swapped.
+ */
+static L4_Bool_t is_mergeable(core_map_entry* page) {
+	return (page->flags & ~FRAME_DIRTY) == FRAME_TRACKED;
+}
+
+
+/**
+ * Frames other pages can be merged with: mergeable pages and frames
+ * which are shared already (they are mapped read-only, so their
+ * contents can't change).
+ */
+static L4_Bool_t is_merge_target(core_map_entry* page) {
+	if(is_mergeable(page))
+		return TRUE;
+
+	return (page->flags & FRAME_SHARED) &&
+			!(page->flags & (FRAME_SWAPPING | FRAME_DELETED | FRAME_PINNED | FRAME_TEXT | FRAME_LARGE));
+}
+
+
+/**
+ * Looks at one entry of the core map and merges its page if possible.
+ *
+ * @param index index of the frame
+ */
+static void scan_page(L4_Word_t index) {
+	core_map_entry* page = &core_map[index];
+	if(!is_mergeable(page))
+		return;
+
+	L4_Word_t frame = frame_address(index);
+	L4_Bool_t zero;
+
+	// the user view was flushed when the page was unmapped
+	frame_cache_flush(frame);
+	L4_Word_t checksum = frame_checksum(frame, &zero);
+	vm_stats.merge_scanned++;
+
+	// pages which changed since the last pass are likely to change again
+	L4_Bool_t stable = (checksums[index] == checksum);
+	checksums[index] = checksum;
+	if(!stable)
+		return;
+
+	if(zero) {
+		if(pager_merge_zero(page->tid, page->virtual_address))
+			vm_stats.merge_zero_pages++;
+		return;
+	}
+
+	L4_Word_t vaddr = page->virtual_address;
+	merge_candidate* candidate = &candidates[(checksum ^ (vaddr >> PAGESIZE_LOG2)) % MERGE_BUCKETS];
+
+	// the candidate may have changed or may have been freed since, compare it
+	if(candidate->frame != 0 && candidate->frame != frame && candidate->checksum == checksum &&
+			candidate->virtual_address == vaddr && is_merge_target(frame_entry(candidate->frame)) &&
+			frame_entry(candidate->frame)->virtual_address == vaddr &&
+			!L4_IsThreadEqual(frame_entry(candidate->frame)->tid, page->tid)) {
+
+		frame_cache_flush(candidate->frame);
+		if(memcmp((void*) frame, (void*) candidate->frame, PAGESIZE) == 0) {
+			dprintf(1, "Merging page 0x%X of 0x%X with frame 0x%X\n", page->virtual_address, page->tid, candidate->frame);
+			pager_merge(page->tid, page->virtual_address, candidate->frame);
+			vm_stats.merge_pages++;
+			return;
+		}
+	}
+
+	candidate->frame = frame;
+	candidate->checksum = checksum;
+	candidate->virtual_address = vaddr;
+}
+
+
+/**
+ * Clock alarm scanning the next part of the core map.
+ *
+ * @param owner root thread
+ * @param status unused
+ */
+static void merge_scan(L4_ThreadId_t owner, int status) {
+
+	for(int i=0; i<MERGE_PAGES_PER_SCAN; i++) {
+		scan_page(cursor);
+		cursor = (cursor + 1) % frame_count();
+	}
+
+	int ret = register_alarm(MERGE_INTERVAL, owner, &merge_scan);
+	assert(ret == CLOCK_R_OK);
+}
+
+
+/**
+ * Starts the scanner. The clock driver needs to be started already.
+ */
+void merge_init(void) {
+	checksums = malloc(frame_count() * sizeof(L4_Word_t));
+	assert(checksums != NULL);
+	memset(checksums, 0, frame_count() * sizeof(L4_Word_t));
+
+	int ret = register_alarm(MERGE_INTERVAL, root_thread_g, &merge_scan);
+	assert(ret == CLOCK_R_OK);
+}
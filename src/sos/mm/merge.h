@@ -0,0 +1,6 @@
+#ifndef MERGE_H_
+#define MERGE_H_
+
+void merge_init(void);
+
+#endif /* MERGE_H_ */
@@ -6,9 +6,17 @@
  * the remaining 20 bits just about 2^20 frames (and since we only have about
  * 5k frames were good).
  * One page table entry in both 1st and 2nd tables is always 4 byte (type: `page_t`).
- * Because of our virtual address layout (see below) the page table structure
- * requires about (2^12 * 4) + (2^12 * (2^8 * 4)) bytes = 4 megabytes of space
- * if our virtual address space would be filled out completely.
+ *
+ * Only 281 of the 4096 1 MB regions of the address space can ever hold
+ * pages (text and data 8, heap 256, IPC 1 and stack 16, see the layout
+ * below). So the 1st level table of a process (its page index) only has
+ * an entry for each of these regions (PAGE_INDEX_ENTRIES, about 1 KB
+ * instead of 16 KB). The slot of a region in the page index is the
+ * number of layout regions below it, which is kept in a table shared
+ * by all processes (region_slot). A lookup therefore still costs two
+ * array accesses plus the one in the 2nd level table. A completely
+ * filled address space needs 281 * (2^8 * 4) bytes = 281 KB of 2nd
+ * level tables.
  *
  * The pager_unmap_all is used for testing the page table. It walks through it,
  * reconstructs all the fpages from the table entries and unmaps them. This can
@@ -27,14 +35,106 @@
  *      [[  TEXT  |  DATA  |  HEAP  |  NoAccess | IPC Memory |  NoAccess  |  STACK  |  NoAccess  ]]
  * 0x02000000         0x40000000            0x60000000                         0xC0000000
  *
+ * Every process keeps a bitmap of its populated 2nd level tables.
+ * Unmapping and freeing an address range (e.g. on process deletion)
+ * only visits these and releases the frames through the core map (see
+ * frames.c) in O(1) each, so the cost depends on the memory used by
+ * the process and not on the size of its address space or the number
+ * of pages in the system.
+ *
+ * Page-out Daemon:
+ * ------------------------------------
+ * To keep the page fault path away from the network, the root server
+ * checks after every IPC if the number of free frames dropped below
+ * a low watermark. If so, the reply is sent first and pager_reclaim
+ * then swaps out pages until the free frames plus the frames currently
+ * being written to swap reach the high watermark again. Frames the
+ * root server heap no longer uses are given back first (heap_trim).
+ * Each run is limited to RECLAIM_MAX_CLUSTERS calls of swap_out to
+ * keep the server responsive. The watermarks can be changed at
+ * runtime through the SOS_VM_WATERMARKS syscall.
+ *
+ * Heap and Stack:
+ * ------------------------------------
+ * The heap ends at the break of a process which is moved with the
+ * sbrk syscall (the malloc of libc calls it in morecore). Lowering
+ * the break frees the pages above it. The break can't exceed the
+ * heap limit of the process (HEAP_DEFAULT_LIMIT, changed with the
+ * SOS_HEAP_LIMIT syscall).
+ * The stack starts out with STACK_INITIAL_SIZE and grows down on
+ * faults up to STACK_GROWTH_GAP below its lowest page so far.
+ *
+ * Anonymous pages (bss, heap and stack) which are read before they
+ * are written map a single zero filled frame read-only. Only the first
+ * write allocates a frame, so sparse heaps don't cost memory.
+ *
  * Limitations:
  * ------------------------------------
- * The boundaries for code heap, stack area are static. We implemented have
- * the following limits for the heap/stack size:
+ * The boundaries of the regions are static:
+ *
+ * Max Heap Size:     256 MB
+ * Max Stack Size:    16 MB
+ * Max Text Size:     4 MB
+ * Max Data Size:     4 MB
+ *
+ * Large Pages:
+ * ------------------------------------
+ * 64 KB aligned blocks in text, data, heap and stack are backed by a
+ * run of contiguous frames (frame_alloc_large) and mapped as one large
+ * fpage, which saves 15 page faults and TLB entries per block. This is
+ * only done for blocks next to already used memory and if there are
+ * enough free frames, otherwise (and if no frame run is available)
+ * we fall back to 4 KB pages. The pages of a large page are still
+ * tracked one by one in the core map; once one of them is evicted
+ * or freed the large page is broken up (see swapper.c).
+ *
+ * Copy on Write:
+ * ------------------------------------
+ * process_clone copies the page table of a process (pager_clone). The
+ * frames of both processes are shared (see swap_share in swapper.c)
+ * and mapped read-only only, since a page is mapped with the rights of
+ * the fault. The first write fault of a process to a shared page gives
+ * it a copy of its own (copy_shared_page).
+ *
+ * Fault-around:
+ * ------------------------------------
+ * Resident pages are unmapped whenever the clock harvests their
+ * reference bit, so sequential access to them would fault page by
+ * page. On a fault we therefore map the resident neighbours in the
+ * aligned window of FAULT_AROUND_PAGES pages as well (one MapControl
+ * call for all of them). These pages are marked speculative and not
+ * referenced, the clock unmaps them like referenced pages but they
+ * only count as referenced once they fault again.
  *
- * Max Heap Size:     4 MB
- * Max Stack Size:    1 MB
- * Max Binary Size: 992 MB [Not used now, will get smaller later]
+ * Swap Readahead:
+ * ------------------------------------
+ * A fault on a swapped page right after (in virtual address or swap
+ * slot) the last one of the process is taken as sequential access.
+ * The following swapped pages within the readahead window of the
+ * process are then read into free frames as well, without anyone
+ * waiting for them. They go into the clock unmapped and unreferenced
+ * (FRAME_PREFETCH) and are mapped by the next fault. A fault on such
+ * a page is a readahead hit which pulls in further pages, so a sweep
+ * over swapped memory keeps the reads in flight ahead of it.
+ * The window starts at READAHEAD_MIN pages, doubles with every
+ * sequential fault which still had to wait for the swap file, grows by
+ * one page with every hit and is halved whenever the clock evicts a
+ * page which was read ahead for nothing (see swapper.c). Readahead
+ * only uses frames above the low watermark and within the quota of
+ * the process, so it never causes page-outs itself.
+ *
+ * Caching:
+ * ------------------------------------
+ * User pages are mapped cacheable (see USER_MAPPINGS_CACHED). The caches
+ * of the ARM are virtually indexed, so whenever the root server touches
+ * a frame through its own 1:1 mapping the lines of both views need to
+ * be maintained explicitly:
+ * - the user view is flushed before a page is unmapped (clock, unmap
+ *   ranges) and before a syscall handler reads the IPC page,
+ * - the root server view is flushed after a frame was zeroed or filled
+ *   from swap and before a frame is written to swap (frame_cache_flush).
+ * Pages read from an executable are flushed the same way as pages
+ * read from swap.
  *
  *
  **/
@@ -64,7 +164,11 @@ for(int i=0; i<4096; i++) {
 
 #include "pager.h"
 #include "swapper.h"
+#include "swapmap.h"
+#include "loader.h"
 #include "frames.h"
+#include "slab.h"
+#include "heap.h"
 #include "../process.h"
 #include "../libsos.h"
 #include "../datastructures/bitfield.h"
@@ -77,12 +181,69 @@ for(int i=0; i<4096; i++) {
 #define OUT_OF_FRAMES 2
 #define PAGE_NOT_AVAILABLE 3
 
+/** Use large pages for suitable regions (comment out to always map 4 KB pages) */
+#define LARGE_PAGES 1
+
+/** Number of pages in the aligned window mapped on a fault (power of 2, at most 32, 1 disables fault-around) */
+#define FAULT_AROUND_PAGES 8
+
+/** Readahead window after the first sequential swap fault (0 disables readahead) */
+#define READAHEAD_MIN 2
+/** Maximum number of pages read ahead of a sequential swap fault */
+#define READAHEAD_MAX 16
+
 #define FIRST_LEVEL_INDEX(addr)  ( (((addr) & 0xFFF00000) >> 20) & 0xFFF )
 #define SECOND_LEVEL_INDEX(addr) (  ((addr) & 0x000FF000) >> 12 )
 #define CREATE_VIRTUAL_ADDRESS(first, second) ( ((first) << 20) | ((second) << 12) )
 
+#define PAGE_TABLE_WORD(slot) ((slot) / 32)
+#define PAGE_TABLE_BIT(slot)  (1UL << ((slot) % 32))
+
+/** Checks if a 1st level index lies in a region of the layout (has a page index slot) */
+#define IN_LAYOUT(index) (region_slot[(index)+1] != region_slot[(index)])
+/** Checks if the 1 MB region starting at `addr` overlaps [start, end) */
+#define REGION_OVERLAPS(addr, start, end) ((addr) < (end) && (addr) + ONE_MEGABYTE > (start))
+
+/** Iterates over the populated 2nd level tables of a process which cover addresses in [start, end) */
+#define FOREACH_SECOND_LEVEL_TABLE(i, p, start, end) \
+	for((i) = next_second_level_table((p), FIRST_LEVEL_INDEX(start)); \
+		(i) < FIRST_LEVEL_ENTRIES && CREATE_VIRTUAL_ADDRESS((i), 0) < (end); \
+		(i) = next_second_level_table((p), (i)+1))
+
 #define IS_SWAPPED(addr)  ((addr) & 0x1)
 
+/** Map user pages cacheable (comment out to map them uncached, e.g. for benchmarks) */
+#define USER_MAPPINGS_CACHED 1
+
+#ifdef USER_MAPPINGS_CACHED
+#define USER_MEMORY_TYPE L4_CachedMemory
+#else
+#define USER_MEMORY_TYPE L4_UncachedMemory
+#endif
+
+// Default watermarks for the page-out daemon (in frames)
+#define RECLAIM_LOW_WATERMARK 32
+#define RECLAIM_HIGH_WATERMARK 64
+/** Maximum number of clusters written by a single pager_reclaim call */
+#define RECLAIM_MAX_CLUSTERS 4
+
+vm_stats_t vm_stats;
+
+static L4_Word_t low_watermark;
+static L4_Word_t high_watermark;
+
+/** Frame mapped read-only for anonymous pages which are only read so far */
+static L4_Word_t zero_frame;
+
+/** Number of layout regions below every 1st level index (= page index slot of the region) */
+static uint16_t region_slot[FIRST_LEVEL_ENTRIES + 1];
+/** 1st level index of the region of every page index slot */
+static uint16_t slot_region[PAGE_INDEX_ENTRIES];
+
+/** Object caches for the first and second level page tables (see slab.c) */
+static slab_cache first_level_cache = SLAB_CACHE_INITIALIZER("page index", page_table_entry[PAGE_INDEX_ENTRIES]);
+static slab_cache second_level_cache = SLAB_CACHE_INITIALIZER("page table", page_table_entry[SECOND_LEVEL_ENTRIES]);
+
 
 /**
  * Gets access rights for a given thread at a certain memory location.
@@ -98,35 +259,24 @@ static L4_Word_t get_access_rights(L4_ThreadId_t tid, L4_Word_t addr) {
 		return L4_NoAccess;
 	}
 
-	process* p = get_process(tid);
-	assert(p != NULL);
-
-	// User space physical memory permission
-	if(!p->initialized && addr < VIRTUAL_START)
-		return L4_FullyAccessible;
-
-	// Text permission
-	if(addr >= TEXT_START && addr < TEXT_END) {
-		if(!p->initialized)
-			return L4_ReadWriteOnly;
-		else
-			return L4_eXecutable | L4_Readable;
-	}
+	// Text permission (text pages are filled by the loader, see loader.c)
+	if(addr >= TEXT_START && addr < TEXT_END)
+		return L4_eXecutable | L4_Readable;
 
 	// Data permission
 	if(addr >= DATA_START && addr < DATA_END)
 		return L4_ReadWriteOnly;
 
-	// Heap permissions
-	if(addr >= HEAP_START && addr < HEAP_END)
+	// Heap permissions (up to the page containing the break)
+	if(addr >= HEAP_START && addr < ROUND_UP_PAGE(get_process(tid)->heap_break))
 		return L4_ReadWriteOnly;
 
 	// IPC permissions
 	if(addr >= IPC_START && addr < IPC_END)
 		return L4_ReadWriteOnly;
 
-	// Stack permissions
-	if(addr > STACK_END  && addr <= STACK_TOP)
+	// Stack permissions (the stack grows on faults right below it, see pager)
+	if(addr >= STACK_END && addr < STACK_TOP && addr + STACK_GROWTH_GAP >= get_process(tid)->stack_bottom)
 		return L4_ReadWriteOnly;
 
 	return L4_NoAccess;
@@ -149,16 +299,17 @@ inline static L4_Bool_t is_access_granted(L4_ThreadId_t tid, L4_Word_t addr, L4_
 /**
  * Performs a lookup in the first level page table.
  *
- * @param index where to look at
- * @return page table entry at position `index`
+ * @param index 1st level index of the region to look at
+ * @return page index entry of the region or NULL if the region
+ * is outside of the layout (or there is no such process)
  */
 static page_table_entry* first_level_lookup(L4_ThreadId_t tid, L4_Word_t index) {
 	assert(index >= 0 && index < FIRST_LEVEL_ENTRIES);
 
-	if(get_process(tid) == NULL)
+	if(get_process(tid) == NULL || !IN_LAYOUT(index))
 		return NULL;
 
-	return get_process(tid)->page_index+index;
+	return get_process(tid)->page_index + region_slot[index];
 }
 
 
@@ -178,103 +329,194 @@ static page_table_entry* second_level_lookup(page_table_entry* second_level_tabl
 /**
  * Reserve space for 2nd level page table and point the corresponding
  * first level entry to it. In addition the allocated region is set to
- * zero.
+ * zero and the table is marked as populated for the process.
  *
- * @param first_level_entry
+ * @param p process owning the page table
+ * @param index first level index of the new table
  */
-static void create_second_level_table(page_table_entry* first_level_entry) {
+static void create_second_level_table(process* p, L4_Word_t index) {
+	assert(IN_LAYOUT(index));
+	L4_Word_t slot = region_slot[index];
+
+	page_table_entry* first_level_entry = p->page_index+slot;
 	assert(first_level_entry->address_ptr == NULL);
 
-	first_level_entry->address_ptr = malloc(SECOND_LEVEL_ENTRIES * sizeof(page_table_entry));
+	first_level_entry->address_ptr = slab_alloc(&second_level_cache);
 	assert(first_level_entry->address_ptr != NULL);
 
 	memset(first_level_entry->address_ptr, 0, SECOND_LEVEL_ENTRIES * sizeof(page_table_entry));
+	p->page_tables[PAGE_TABLE_WORD(slot)] |= PAGE_TABLE_BIT(slot);
 }
 
 
 /**
- * Marks a page as dirty in the page table.
- * @param pte page table entry pointer
+ * Frees a 2nd level page table of a process. The entries in it
+ * need to be released already.
+ *
+ * @param p process owning the page table
+ * @param index first level index of the table
  */
-static void mark_dirty(page_table_entry* pte) {
-	assert(pte != NULL);
-	assert(!IS_SWAPPED((L4_Word_t)pte->address_ptr)); // marking swapped page dirty would not make sense
-
-	L4_Word_t current = (L4_Word_t) pte->address_ptr;
-	pte->address = (current | 0x2);
+static void free_second_level_table(process* p, L4_Word_t index) {
+	assert(IN_LAYOUT(index));
+	L4_Word_t slot = region_slot[index];
+	assert(p->page_tables[PAGE_TABLE_WORD(slot)] & PAGE_TABLE_BIT(slot));
+
+	slab_free(p->page_index[slot].address_ptr);
+	p->page_index[slot].address_ptr = NULL;
+	p->page_tables[PAGE_TABLE_WORD(slot)] &= ~PAGE_TABLE_BIT(slot);
 }
 
 
 /**
- * Allocates a page_queue_item and initializes it with the arguments given.
- * @return pointer to the page_queue_item
+ * Allocates an empty first level page table (page index) for
+ * a new process.
+ *
+ * @return the page index
  */
-static page_queue_item* create_page_queue_item(L4_ThreadId_t tid, L4_Word_t addr, int swap_offset) {
-	page_queue_item* p = malloc(sizeof(page_queue_item));
-	assert(p != NULL);
+page_table_entry* pager_alloc_page_index(void) {
+	page_table_entry* page_index = slab_alloc(&first_level_cache);
+	assert(page_index != NULL);
 
-	p->tid = tid;
-	p->virtual_address = addr;
-	p->swap_offset = swap_offset;
-	p->process_deleted = FALSE;
+	for(int i=0; i<PAGE_INDEX_ENTRIES; i++)
+		page_index[i].address_ptr = NULL;
 
-	return p;
+	return page_index;
 }
 
 
 /**
- * Initializes 1st level page table structure by allocating it on the heap.
- * Initially all entries are set to 0.
+ * Frees a first level page table. Its 2nd level tables need to
+ * be freed already (see pager_free_all).
+ *
+ * @param page_index the page index (may be NULL)
  */
-void pager_init() {
-	swap_init();
+void pager_free_page_index(page_table_entry* page_index) {
+	slab_free(page_index);
 }
 
 
 /**
- * Performs a one to one mapping between virtual and physical address. This is used to address the RAM directly.
+ * Finds the next populated first level entry of a process by
+ * looking at the bitmap of populated 2nd level tables. Empty
+ * parts of the address space are skipped 32 entries at a time.
  *
- * @param tid ID of the thread to map for
- * @param addr memory location to map
- * @return 	MAPPING_FAILED iff Mapping failed
- * 			MAPPING_SUCCESS iff Mappfing success
+ * @param p process
+ * @param index first level index to start searching at
+ * @return index of the next entry >= `index` which has a 2nd level
+ * table or FIRST_LEVEL_ENTRIES if there is none
  */
-static L4_Bool_t one_to_one_mapping(L4_ThreadId_t tid, L4_Word_t addr, L4_Word_t requested_access) {
+static L4_Word_t next_second_level_table(process* p, L4_Word_t index) {
+	// first slot of a region at or above index (regions are in address order)
+	L4_Word_t slot = region_slot[min(index, FIRST_LEVEL_ENTRIES)];
 
-	addr = ((addr >> PAGESIZE_LOG2) << PAGESIZE_LOG2);
+	while(slot < PAGE_INDEX_ENTRIES) {
+		L4_Word_t bits = p->page_tables[PAGE_TABLE_WORD(slot)] >> (slot % 32);
+
+		if(bits != 0)
+			return slot_region[slot + __builtin_ctz(bits)];
 
-	// Construct fpage IPC message
-	L4_Fpage_t targetFpage = L4_FpageLog2(addr, 12);
-	L4_Set_Rights(&targetFpage, L4_FullyAccessible);
+		slot = (PAGE_TABLE_WORD(slot) + 1) * 32;
+	}
 
-	// Assumes virtual - physical 1-1 mapping
-	L4_PhysDesc_t phys = L4_PhysDesc(addr, L4_DefaultMemory);
+	return FIRST_LEVEL_ENTRIES;
+}
 
-	return L4_MapFpage(tid, targetFpage, phys);
+
+/**
+ * Marks a page as dirty in the core map.
+ * @param pte page table entry pointer
+ */
+static void mark_dirty(page_table_entry* pte) {
+	assert(pte != NULL);
+	assert(!IS_SWAPPED((L4_Word_t)pte->address_ptr)); // marking swapped page dirty would not make sense
+
+	frame_entry(CLEAR_LOWER_BITS(pte->address))->flags |= FRAME_DIRTY;
+}
+
+
+/**
+ * Marks a page as referenced in the core map. This is done
+ * every time the page is mapped (see swapper.c).
+ * @param pte page table entry pointer
+ */
+static void mark_referenced(page_table_entry* pte) {
+	assert(pte != NULL);
+	assert(!IS_SWAPPED((L4_Word_t)pte->address_ptr));
+
+	core_map_entry* page = frame_entry(CLEAR_LOWER_BITS(pte->address));
+	page->flags = (page->flags | FRAME_REFERENCED) & ~FRAME_SPECULATIVE;
+}
+
+
+/**
+ * Initializes the pager: watermarks, zero page, the page index slots
+ * of the layout regions and the swap subsystem.
+ */
+void pager_init() {
+	memset(&vm_stats, 0, sizeof(vm_stats_t));
+
+	// make sure small memory configurations (see SWAP_TEST) don't
+	// end up reclaiming all the time
+	high_watermark = min(RECLAIM_HIGH_WATERMARK, frame_count_free() / 4);
+	low_watermark = min(RECLAIM_LOW_WATERMARK, high_watermark / 2);
+
+	// frames are handed out zeroed, the zero page is never written afterwards
+	zero_frame = frame_alloc();
+	assert(zero_frame != 0);
+	frame_entry(zero_frame)->flags = FRAME_PINNED;
+
+	// number the regions of the layout for the page index
+	L4_Word_t slot = 0;
+	for(L4_Word_t index=0; index<FIRST_LEVEL_ENTRIES; index++) {
+		L4_Word_t addr = CREATE_VIRTUAL_ADDRESS(index, 0);
+		region_slot[index] = slot;
+
+		if(REGION_OVERLAPS(addr, TEXT_START, DATA_END) || REGION_OVERLAPS(addr, HEAP_START, HEAP_END) ||
+		   REGION_OVERLAPS(addr, IPC_START, IPC_END) || REGION_OVERLAPS(addr, STACK_END, STACK_TOP))
+			slot_region[slot++] = index;
+	}
+	region_slot[FIRST_LEVEL_ENTRIES] = slot;
+	assert(slot == PAGE_INDEX_ENTRIES);
+
+	swap_init();
 }
 
 
 /**
  * Allocates a new frame for a given thread.
  * In case we run out of free frame this method initiates
- * the swapping.
+ * the swapping. A process which has used up its frame quota
+ * has to swap out one of its own pages first (see swapper.c).
  * @param for_thread Thread ID which requested a frame
  * @return NULL in case no frame can be returned yet
  * valid pointer to a frame otherwise.
  */
 static void* allocate_new_frame(L4_ThreadId_t for_thread) {
+	process* p = get_process(for_thread);
 
-	L4_Word_t new_frame = 0;
-	if((new_frame = frame_alloc()) == 0) {
+	// if the process has no page to give up it takes a free frame after all
+	if(p->frame_quota != 0 && p->resident >= p->frame_quota) {
+		vm_stats.local_reclaims++;
 
-		switch(swap_out(for_thread)) {
+		if(swap_out(for_thread, TRUE) == SWAPPING_PENDING)
+			return NULL;
+	}
+
+	L4_Word_t new_frame = frame_alloc();
+	if(new_frame == 0)
+		vm_stats.direct_reclaims++;
+
+	while(new_frame == 0) {
+
+		switch(swap_out(for_thread, FALSE)) {
 
 			case SWAPPING_COMPLETE:
 				// non dirty pages can be swapped and free'd
-				// without requiring any IO
+				// without requiring any IO, but the metadata swap_out
+				// allocates may have grown the heap into the freed
+				// frames (heap_grow), in that case evict again
 				new_frame = frame_alloc();
-				assert(new_frame != 0);
-			break;
+			continue;
 
 			case NO_PAGE_AVAILABLE:
 				// This can happen if you have a lot of processes
@@ -296,25 +538,274 @@ static void* allocate_new_frame(L4_ThreadId_t for_thread) {
 
 		}
 
+		break;
 	}
 
 	return (void*) new_frame;
 }
 
 
+/**
+ * Checks if the large page sized block containing `addr` should be
+ * backed by a large page. This is the case if the block lies within
+ * text, data, heap or stack, none of its pages has been touched yet
+ * and the page right before it (in the direction the region grows)
+ * is already in use. So regions which are only used a little (like
+ * the top of the stack of most processes) don't waste a large page.
+ * Blocks with parts which are read from the executable are left to
+ * the loader. In addition there need to be enough free frames left
+ * for the page-out daemon.
+ *
+ * @param tid thread ID
+ * @param addr faulting address
+ * @return TRUE if a large page should be used
+ */
+static L4_Bool_t is_large_page_candidate(L4_ThreadId_t tid, L4_Word_t addr) {
+#ifdef LARGE_PAGES
+	L4_Word_t block = addr & ~(LARGE_PAGESIZE - 1);
+	process* p = get_process(tid);
+	L4_Word_t neighbour;
+
+	if((block >= TEXT_START && block + LARGE_PAGESIZE <= DATA_END) ||
+	   (block >= HEAP_START && block + LARGE_PAGESIZE <= ROUND_UP_PAGE(p->heap_break)))
+		neighbour = block - PAGESIZE;
+	else if(block >= p->stack_bottom && block + LARGE_PAGESIZE <= STACK_TOP)
+		neighbour = block + LARGE_PAGESIZE;
+	else
+		return FALSE;
+
+	if(frame_count_free() < high_watermark + PAGES_PER_LARGE_PAGE)
+		return FALSE;
+
+	if(loader_is_file_backed(&p->image, block, LARGE_PAGESIZE))
+		return FALSE;
+
+	page_table_entry* neighbour_entry = pager_table_lookup(tid, neighbour);
+	if(neighbour_entry == NULL || neighbour_entry->address_ptr == NULL || neighbour_entry->address == zero_frame)
+		return FALSE;
+
+	for(L4_Word_t page = block; page < block + LARGE_PAGESIZE; page += PAGESIZE) {
+		if(pager_table_lookup(tid, page)->address_ptr != NULL)
+			return FALSE;
+	}
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+
+/**
+ * Checks if a page is anonymous memory, i.e. it starts out zero filled
+ * and is not read from the executable (bss, heap and stack).
+ *
+ * @param tid thread ID
+ * @param addr page address
+ * @return TRUE if the page can be backed by the zero page
+ */
+static L4_Bool_t is_anonymous(L4_ThreadId_t tid, L4_Word_t addr) {
+	return addr >= DATA_START && addr != (L4_Word_t)ipc_memory_start &&
+			!loader_is_file_backed(&get_process(tid)->image, addr, PAGESIZE);
+}
+
+
+/**
+ * Maps a resident large page as one fpage and marks all its pages
+ * as referenced (and dirty for write access).
+ *
+ * @param tid thread ID
+ * @param block virtual address of the large page
+ * @param frame first frame of the large page
+ * @param requested_access access rights
+ * @return result of L4_MapFpage
+ */
+static int map_large_page(L4_ThreadId_t tid, L4_Word_t block, L4_Word_t frame, L4_Word_t requested_access) {
+
+	for(L4_Word_t i=0; i<PAGES_PER_LARGE_PAGE; i++) {
+		core_map_entry* page = frame_entry(frame + i*PAGESIZE);
+		assert(page->flags & FRAME_LARGE);
+
+		page->flags |= FRAME_REFERENCED;
+		if(requested_access & L4_Writable)
+			page->flags |= FRAME_DIRTY;
+	}
+
+	L4_Fpage_t targetFpage = L4_FpageLog2(block, LARGE_PAGESIZE_LOG2);
+	L4_Set_Rights(&targetFpage, requested_access);
+	L4_PhysDesc_t phys = L4_PhysDesc(frame, USER_MEMORY_TYPE);
+
+	dprintf(1, "Trying to map large page at virtual address %X with physical %X\n", block, frame);
+	return L4_MapFpage(tid, targetFpage, phys);
+}
+
+
+/**
+ * Backs the large page sized block containing `addr` with a run of
+ * contiguous frames and maps it as one large fpage.
+ *
+ * @param tid thread ID
+ * @param addr faulting address
+ * @param requested_access access rights
+ * @return MAPPING_SUCCESS, MAPPING_FAILED or OUT_OF_FRAMES if
+ * no suitable frame run was found (use 4 KB pages then)
+ */
+static int large_page_mapping(L4_ThreadId_t tid, L4_Word_t addr, L4_Word_t requested_access) {
+	L4_Word_t block = addr & ~(LARGE_PAGESIZE - 1);
+
+	L4_Word_t frame = frame_alloc_large();
+	if(frame == 0) {
+		vm_stats.large_page_fallbacks++;
+		return OUT_OF_FRAMES;
+	}
+
+	for(L4_Word_t i=0; i<PAGES_PER_LARGE_PAGE; i++)
+		pager_table_lookup(tid, block + i*PAGESIZE)->address = frame + i*PAGESIZE;
+
+	get_process(tid)->size += PAGES_PER_LARGE_PAGE;
+	swap_track_large(tid, block, frame);
+	vm_stats.large_page_maps++;
+
+	return map_large_page(tid, block, frame, requested_access);
+}
+
+
+/**
+ * Maps a page together with the resident but unmapped pages in the
+ * aligned window of FAULT_AROUND_PAGES pages around it, all in one
+ * system call. Only pages in the clock qualify. They are mapped
+ * read-only unless they are dirty already (so the dirty bit stays
+ * accurate) and marked as speculative instead of referenced, so the
+ * clock still sees which of them are actually used.
+ *
+ * @param tid thread ID
+ * @param addr faulting page
+ * @param frame frame of the faulting page
+ * @param requested_access access rights for the faulting page
+ * @return result of L4_MapFpages
+ */
+static int map_fault_around(L4_ThreadId_t tid, L4_Word_t addr, L4_Word_t frame, L4_Word_t requested_access) {
+	L4_Fpage_t fpages[FAULT_AROUND_PAGES];
+	L4_PhysDesc_t descs[FAULT_AROUND_PAGES];
+	int count = 0;
+
+	fpages[count] = L4_FpageLog2(addr, PAGESIZE_LOG2);
+	L4_Set_Rights(&fpages[count], requested_access);
+	descs[count++] = L4_PhysDesc(frame, USER_MEMORY_TYPE);
+
+	// the window never crosses a 2nd level table
+	L4_Word_t window = addr & ~(FAULT_AROUND_PAGES * PAGESIZE - 1);
+	for(L4_Word_t neighbour = window; neighbour < window + FAULT_AROUND_PAGES * PAGESIZE; neighbour += PAGESIZE) {
+		page_table_entry* pte = pager_table_lookup(tid, neighbour);
+
+		if(neighbour == addr || pte->address_ptr == NULL || IS_SWAPPED(pte->address))
+			continue;
+
+		core_map_entry* page = frame_entry(CLEAR_LOWER_BITS(pte->address));
+		// pages read ahead fault once, so we know if the readahead was used
+		if((page->flags & (FRAME_TRACKED | FRAME_REFERENCED | FRAME_SPECULATIVE | FRAME_LARGE | FRAME_PREFETCH)) != FRAME_TRACKED)
+			continue;
+
+		L4_Word_t rights = get_access_rights(tid, neighbour);
+		if(!(page->flags & FRAME_DIRTY))
+			rights &= ~L4_Writable;
+		if(rights == L4_NoAccess)
+			continue;
+
+		page->flags |= FRAME_SPECULATIVE;
+		fpages[count] = L4_FpageLog2(neighbour, PAGESIZE_LOG2);
+		L4_Set_Rights(&fpages[count], rights);
+		descs[count++] = L4_PhysDesc(CLEAR_LOWER_BITS(pte->address), USER_MEMORY_TYPE);
+	}
+
+	vm_stats.fault_around_pages += count - 1;
+	return L4_MapFpages(tid, count, fpages, descs);
+}
+
+
+/**
+ * Reads the swapped pages in the readahead window behind a page
+ * into free frames. Pages which are not swapped (resident or already
+ * read ahead) are skipped.
+ *
+ * @param tid thread ID
+ * @param addr page the window starts behind
+ */
+static void readahead(L4_ThreadId_t tid, L4_Word_t addr) {
+	process* p = get_process(tid);
+
+	for(L4_Word_t i=1; i<=p->readahead_window; i++) {
+		L4_Word_t next = addr + i*PAGESIZE;
+		page_table_entry* pte = pager_table_lookup(tid, next);
+
+		if(pte == NULL || !IS_SWAPPED(pte->address))
+			continue;
+
+		// readahead must not push out other pages
+		if(frame_count_free() <= low_watermark)
+			break;
+		if(p->frame_quota != 0 && p->resident >= p->frame_quota)
+			break;
+
+		L4_Word_t frame = frame_alloc();
+		if(frame == 0)
+			break;
+
+		L4_Word_t swap_offset = CLEAR_LOWER_BITS(pte->address);
+		pte->address = frame;
+		swap_in(tid, next, frame, swap_offset, TRUE);
+		vm_stats.readahead_pages++;
+	}
+
+}
+
+
+/**
+ * Gives a process its own copy of a shared page it wants to write
+ * to. The read-only mapping of the shared frame is removed.
+ *
+ * @param tid thread ID
+ * @param addr virtual address of the page
+ * @param pte page table entry pointing to the shared frame
+ * @return MAPPING_SUCCESS or OUT_OF_FRAMES if we need to wait for a frame
+ */
+static int copy_shared_page(L4_ThreadId_t tid, L4_Word_t addr, page_table_entry* pte) {
+	L4_Word_t shared_frame = CLEAR_LOWER_BITS(pte->address);
+
+	void* new_frame = allocate_new_frame(tid);
+	if(new_frame == NULL)
+		return OUT_OF_FRAMES;
+
+	// users can't write to shared frames, so there are no cache lines to write back
+	memcpy(new_frame, (void*)shared_frame, PAGESIZE);
+	frame_cache_flush((L4_Word_t)new_frame);
+
+	L4_UnmapFpage(tid, L4_FpageLog2(addr, PAGESIZE_LOG2));
+	pte->address_ptr = new_frame;
+	swap_unshare(shared_frame);
+	swap_track(tid, addr, (L4_Word_t)new_frame);
+
+	vm_stats.cow_copies++;
+	return MAPPING_SUCCESS;
+}
+
+
 /**
  * Does a 2 Level Pagetable Lookup to map the virtual address space into
  * physical. In addition swapping in and/or swapping out is initialized
  * if we run out of physical memory or a requested page is currently
- * swapped out. Newly mapped pages are inserted into the active
- * pages queue (used by swapper.c).
+ * swapped out. Pages of the executable are read from the file when
+ * they are touched for the first time (see loader.c). Writes to pages
+ * shared with other processes get a copy of the page. Newly mapped
+ * pages are inserted into the clock (see swapper.c) and recorded in
+ * the core map.
  *
  * @param tid ID of thread to map for
  * @param addr memory area to map (aligned to multiple of PAGESIZE)
  * @return	MAPPING_FAILED iff Mapping failed
  *			MAPPING_SUCCESS iff Mapping success
  *			OUT_OF_FRAMES iff no more free frames (swapping started)
- *			PAGE_NOT_AVAILABLE iff the page needs to be swapped in
+ *			PAGE_NOT_AVAILABLE iff the page needs to be swapped in or loaded
  */
 static int virtual_mapping(L4_ThreadId_t tid, L4_Word_t addr, L4_Word_t requested_access) {
 	assert(is_access_granted(tid, addr, requested_access));
@@ -325,27 +816,65 @@ static int virtual_mapping(L4_ThreadId_t tid, L4_Word_t addr, L4_Word_t requeste
 	page_table_entry* first_entry = first_level_lookup(tid, FIRST_LEVEL_INDEX(addr));
 	if(first_entry->address_ptr == NULL) {
 		dprintf(3, "No 2nd Level table exists here. Create one.\n");
-		create_second_level_table(first_entry); // set up new 2nd level page table
+		create_second_level_table(get_process(tid), FIRST_LEVEL_INDEX(addr)); // set up new 2nd level page table
 	}
 
 	page_table_entry* second_entry = second_level_lookup(first_entry->address_ptr, SECOND_LEVEL_INDEX(addr));
 
-	// Page referenced for the first time
-	if(second_entry->address_ptr == NULL) {
+	// Anonymous memory which is only read is backed by the zero page
+	if(second_entry->address_ptr == NULL && !(requested_access & L4_Writable) && is_anonymous(tid, addr)) {
+		second_entry->address = zero_frame;
+		vm_stats.zero_page_maps++;
+	}
 
-		get_process(tid)->size += 1; // maintain prozess state for ps output
+	if(second_entry->address == zero_frame) {
+		if(!(requested_access & L4_Writable)) {
+			L4_Fpage_t targetFpage = L4_FpageLog2(addr, PAGESIZE_LOG2);
+			L4_Set_Rights(&targetFpage, requested_access);
+			return L4_MapFpage(tid, targetFpage, L4_PhysDesc(zero_frame, USER_MEMORY_TYPE));
+		}
+
+		// first write, the page gets a frame of its own (the mapping is replaced)
+		second_entry->address_ptr = NULL;
+	}
+
+	// Block touched for the first time, try to use a large page
+	if(second_entry->address_ptr == NULL && is_large_page_candidate(tid, addr)) {
+		int ret = large_page_mapping(tid, addr, requested_access);
+		if(ret != OUT_OF_FRAMES)
+			return ret;
+	}
+
+	// Text page referenced for the first time which is already loaded by another instance
+	if(second_entry->address_ptr == NULL && (second_entry->address = loader_text_share(tid, addr)) != 0) {
+		get_process(tid)->size += 1;
+	}
+
+	// Page referenced for the first time
+	else if(second_entry->address_ptr == NULL) {
 
 		if( (second_entry->address_ptr = allocate_new_frame(tid)) == NULL ) {
 			return OUT_OF_FRAMES;
 		}
 
+		get_process(tid)->size += 1; // maintain prozess state for ps output
+
+		// text and data is read from the executable
+		if(loader_is_file_backed(&get_process(tid)->image, addr, PAGESIZE)) {
+			loader_page_in(tid, addr, CLEAR_LOWER_BITS(second_entry->address));
+			return PAGE_NOT_AVAILABLE;
+		}
+
 		// shared ipc memory pages are never swapped out
 		if(addr != (L4_Word_t)ipc_memory_start) {
-			// insert page into queue of active pages
-			page_queue_item* p = create_page_queue_item(tid, addr, -1);
-			TAILQ_INSERT_TAIL(&active_pages_head, p, entries);
-			// new allocated pages are always dirty
-			mark_dirty(second_entry);
+			// insert page into the clock (new allocated pages are always dirty)
+			swap_track(tid, addr, CLEAR_LOWER_BITS(second_entry->address));
+		}
+		else {
+			core_map_entry* ipc_frame = frame_entry(CLEAR_LOWER_BITS(second_entry->address));
+			ipc_frame->tid = tid;
+			ipc_frame->virtual_address = addr;
+			ipc_frame->flags = FRAME_PINNED;
 		}
 
 		dprintf(2, "New allocated physical frame: %X\n", second_entry->address);
@@ -360,23 +889,65 @@ static int virtual_mapping(L4_ThreadId_t tid, L4_Word_t addr, L4_Word_t requeste
 			return OUT_OF_FRAMES;
 		}
 
+		process* p = get_process(tid);
+		L4_Bool_t sequential = (addr == p->last_swap_fault + PAGESIZE || (int)swap_offset == p->last_swap_offset + PAGESIZE);
+		p->last_swap_fault = addr;
+		p->last_swap_offset = swap_offset;
+
 		second_entry->address_ptr = new_frame;
-		page_queue_item* p = create_page_queue_item(tid, addr, swap_offset);
-		swap_in(p);
-		return PAGE_NOT_AVAILABLE;
+		int ret = swap_in(tid, addr, (L4_Word_t)new_frame, swap_offset, FALSE);
+
+		if(sequential) {
+			// the window was too small to get ahead of the faults (pages
+			// from the compressed pool don't need a bigger one)
+			if(ret == SWAPPING_PENDING)
+				p->readahead_window = min(max(p->readahead_window * 2, READAHEAD_MIN), READAHEAD_MAX);
+			readahead(tid, addr);
+		}
+
+		// pages from the compressed pool are there right away
+		if(ret == SWAPPING_PENDING)
+			return PAGE_NOT_AVAILABLE;
+	}
+
+	core_map_entry* page = frame_entry(CLEAR_LOWER_BITS(second_entry->address));
+
+	// first use of a page which was read ahead
+	if(page->flags & FRAME_PREFETCH) {
+		process* p = get_process(tid);
+		page->flags &= ~FRAME_PREFETCH;
+		p->last_swap_fault = addr;
+		p->readahead_window = min(p->readahead_window + 1, READAHEAD_MAX);
+		vm_stats.readahead_hits++;
+
+		readahead(tid, addr);
+
+		// still being read, swap_read_done restarts the thread
+		if(page->flags & FRAME_SWAPPING)
+			return PAGE_NOT_AVAILABLE;
+	}
+
+	// write to a page shared with another process (copy on write)
+	if((page->flags & FRAME_SHARED) && (requested_access & L4_Writable)) {
+		if(copy_shared_page(tid, addr, second_entry) == OUT_OF_FRAMES)
+			return OUT_OF_FRAMES;
+
+		page = frame_entry(CLEAR_LOWER_BITS(second_entry->address));
+	}
+
+	// resident parts of a large page are mapped together
+	if(page->flags & FRAME_LARGE) {
+		L4_Word_t frame = CLEAR_LOWER_BITS(second_entry->address) & ~(LARGE_PAGESIZE - 1);
+		return map_large_page(tid, addr & ~(LARGE_PAGESIZE - 1), frame, requested_access);
 	}
 
 	if(requested_access & L4_Writable)
 		mark_dirty(second_entry);
+	mark_referenced(second_entry);
 
 	// else page just isn't mapped in hardware
-	L4_Fpage_t targetFpage = L4_FpageLog2(addr, PAGESIZE_LOG2);
-	L4_Set_Rights(&targetFpage, requested_access);
-	L4_Word_t memory_type = (addr != (L4_Word_t)ipc_memory_start) ? L4_UncachedMemory : L4_UncachedMemory;
-	L4_PhysDesc_t phys = L4_PhysDesc(CLEAR_LOWER_BITS(second_entry->address), memory_type);
-
 	dprintf(1, "Trying to map virtual address %X with physical %X\n", addr, CLEAR_LOWER_BITS(second_entry->address));
-	return L4_MapFpage(tid, targetFpage, phys);
+	return map_fault_around(tid, addr, CLEAR_LOWER_BITS(second_entry->address), requested_access);
 }
 
 
@@ -395,6 +966,7 @@ int pager(L4_ThreadId_t tid, L4_Msg_t *msgP)
     L4_Word_t addr = L4_MsgWord(msgP, 0);
     L4_Word_t ip = L4_MsgWord(msgP, 1);
     L4_Word_t fault_reason = L4_Label(msgP->tag) & 0xF; // permissions are stored in lower 4 bit of label
+    vm_stats.page_faults++;
 
 	dprintf(1, "PAGEFAULT: pager(tid: %X,\n\t\t faulting_ip: 0x%X,\n\t\t faulting_addr: 0x%X,\n\t\t fault_reason: 0x%X)\n", tid, ip, addr, fault_reason);
 
@@ -407,40 +979,34 @@ int pager(L4_ThreadId_t tid, L4_Msg_t *msgP)
 		return 0;
 	}
 
-	if(addr < VIRTUAL_START) {
-
-		// For addresses below VIRTUAL_START we just do 1 to 1 mapping of addresses
-		if (!one_to_one_mapping(tid, addr, fault_reason)) {
-			sos_print_error(L4_ErrorCode());
-			dprintf(0, "Can't map page at %lx\n", addr);
-		}
-
+	// fault right below the stack, let it grow
+	process* p = get_process(tid);
+	if(addr >= STACK_END && addr < p->stack_bottom) {
+		p->stack_bottom = CLEAR_LOWER_BITS(addr);
+		vm_stats.stack_growths++;
 	}
-	else {
-
-		// perform a 2 level page table lookup
-		int ret = virtual_mapping(tid, addr, fault_reason);
-		switch(ret) {
-			case MAPPING_FAILED:
-				sos_print_error(L4_ErrorCode());
-				dprintf(0, "Can't map page at %lx. Either MapFpage failed or we're out of memory.\n", addr);
-			break;
-
-			case OUT_OF_FRAMES:
-				// we're swapping and we have stopped the thread so don't send a reply (yet)
-				// the thread will be started again once swapping is completed
-				// (see swap_write_callback)
-				return 0;
-			break;
-
-			case PAGE_NOT_AVAILABLE:
-				// we need to swap-in the requested page first
-				// since this takes some time we stopped the thread (and restart it when it's done)
-				// and don't return a IPC message
-				return 0;
-			break;
-		}
 
+	// perform a 2 level page table lookup
+	int ret = virtual_mapping(tid, addr, fault_reason);
+	switch(ret) {
+		case MAPPING_FAILED:
+			sos_print_error(L4_ErrorCode());
+			dprintf(0, "Can't map page at %lx. Either MapFpage failed or we're out of memory.\n", addr);
+		break;
+
+		case OUT_OF_FRAMES:
+			// we're swapping and we have stopped the thread so don't send a reply (yet)
+			// the thread will be started again once swapping is completed
+			// (see swap_write_done)
+			return 0;
+		break;
+
+		case PAGE_NOT_AVAILABLE:
+			// we need to swap-in (or load from the executable) the requested page first
+			// since this takes some time we stopped the thread (and restart it when it's done)
+			// and don't return a IPC message
+			return 0;
+		break;
 	}
 
 	// Generate Reply message
@@ -460,37 +1026,237 @@ int pager_unmap_all(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
 }
 
 
+/**
+ * System call handler
+ * Copies the current virtual memory statistics into the shared IPC memory.
+ *
+ * @param tid Callee Thread ID
+ * @param msg_p IPC Message
+ * @param buf Shared IPC memory
+ * @return 1 (send a reply)
+ */
+int pager_stats(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
+	if(buf == NULL)
+		return IPC_SET_ERROR(-1);
+
+	L4_Word_t zero_hits, zero_misses;
+	frame_zero_stats(&zero_hits, &zero_misses);
+
+	vm_stats.free_frames = frame_count_free();
+	vm_stats.frame_fragmentation = frame_fragmentation(LARGE_PAGE_ORDER);
+	vm_stats.largest_free_order = frame_largest_free_order();
+	vm_stats.low_watermark = low_watermark;
+	vm_stats.high_watermark = high_watermark;
+	vm_stats.zero_pool_hits = zero_hits;
+	vm_stats.zero_pool_misses = zero_misses;
+	vm_stats.swap_slots_used = swapmap_used();
+	vm_stats.swap_slots_total = swapmap_size();
+	vm_stats.slab_cache_count = slab_stats(vm_stats.slab_caches, VM_SLAB_CACHES);
+
+	memcpy(buf, &vm_stats, sizeof(vm_stats_t));
+	return set_ipc_reply(msg_p, 1, 0);
+}
+
+
+/**
+ * System call handler
+ * Sets the free frame watermarks of the page-out daemon.
+ * A low watermark of 0 disables proactive reclaiming.
+ *
+ * @param tid Callee Thread ID
+ * @param msg_p IPC Message (low and high watermark)
+ * @param buf Shared IPC memory (not used)
+ * @return 1 (send a reply)
+ */
+int pager_set_watermarks(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
+	if(L4_UntypedWords(msg_p->tag) != 2)
+		return IPC_SET_ERROR(-1);
+
+	L4_Word_t low = L4_MsgWord(msg_p, 0);
+	L4_Word_t high = L4_MsgWord(msg_p, 1);
+
+	if(low > high)
+		return IPC_SET_ERROR(-1);
+
+	low_watermark = low;
+	high_watermark = high;
+
+	dprintf(1, "Page-out daemon watermarks set to low:%d high:%d\n", low_watermark, high_watermark);
+	return set_ipc_reply(msg_p, 1, 0);
+}
+
+
+/**
+ * System call handler
+ * Moves the break (end of the heap) of the callee by a number of
+ * bytes. Pages which lie above a lowered break are freed.
+ *
+ * @param tid Callee Thread ID
+ * @param msg_p IPC Message (increment in bytes, may be negative)
+ * @param buf Shared IPC memory (not used)
+ * @return 1 (send the old break or -1 if the new break would be
+ * outside of the heap limit of the process)
+ */
+int pager_sbrk(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
+	if(L4_UntypedWords(msg_p->tag) != 1)
+		return IPC_SET_ERROR(-1);
+
+	process* p = get_process(tid);
+	L4_Word_t old_break = p->heap_break;
+	L4_Word_t new_break = old_break + (long) L4_MsgWord(msg_p, 0);
+
+	// a wrapped around break ends up outside as well
+	if(new_break < HEAP_START || new_break > HEAP_START + p->heap_limit)
+		return IPC_SET_ERROR(-1);
+
+	if(ROUND_UP_PAGE(new_break) < ROUND_UP_PAGE(old_break)) {
+		pager_unmap_range(tid, ROUND_UP_PAGE(new_break), ROUND_UP_PAGE(old_break));
+		pager_free_range(tid, ROUND_UP_PAGE(new_break), ROUND_UP_PAGE(old_break));
+	}
+
+	p->heap_break = new_break;
+	dprintf(2, "sbrk for 0x%X: break moved from 0x%X to 0x%X\n", tid, old_break, new_break);
+	return set_ipc_reply(msg_p, 1, old_break);
+}
+
+
+/**
+ * System call handler
+ * Sets the maximum size of the heap of a process. The limit can't
+ * be lower than the current heap size or exceed HEAP_END.
+ *
+ * @param tid Callee Thread ID
+ * @param msg_p IPC Message (pid and limit in bytes)
+ * @param buf Shared IPC memory (not used)
+ * @return 1 (send a reply)
+ */
+int pager_set_heap_limit(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
+	if(L4_UntypedWords(msg_p->tag) != 2)
+		return IPC_SET_ERROR(-1);
+
+	pid_t pid = L4_MsgWord(msg_p, 0);
+	L4_Word_t limit = L4_MsgWord(msg_p, 1);
+
+	if(pid <= 0 || pid >= MAX_RUNNING_PROCESS || !get_process(pid2tid(pid))->is_active)
+		return IPC_SET_ERROR(-1);
+
+	process* p = get_process(pid2tid(pid));
+	if(limit > HEAP_END - HEAP_START || HEAP_START + limit < p->heap_break)
+		return IPC_SET_ERROR(-1);
+
+	p->heap_limit = limit;
+	return set_ipc_reply(msg_p, 1, 0);
+}
+
+
+/**
+ * System call handler
+ * Sets the frame quota of a process. A process whose resident pages
+ * reach its quota replaces its own pages. A quota of 0 removes the
+ * limit.
+ *
+ * @param tid Callee Thread ID
+ * @param msg_p IPC Message (pid and quota in frames)
+ * @param buf Shared IPC memory (not used)
+ * @return 1 (send a reply)
+ */
+int pager_set_frame_quota(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
+	if(L4_UntypedWords(msg_p->tag) != 2)
+		return IPC_SET_ERROR(-1);
+
+	pid_t pid = L4_MsgWord(msg_p, 0);
+	L4_Word_t quota = L4_MsgWord(msg_p, 1);
+
+	if(pid <= 0 || pid >= MAX_RUNNING_PROCESS || !get_process(pid2tid(pid))->is_active)
+		return IPC_SET_ERROR(-1);
+
+	get_process(pid2tid(pid))->frame_quota = quota;
+	return set_ipc_reply(msg_p, 1, 0);
+}
+
+
+/**
+ * Checks if the page-out daemon should run.
+ *
+ * @return TRUE if we're below the low watermark of free frames
+ */
+L4_Bool_t pager_reclaim_needed(void) {
+	return frame_count_free() < low_watermark;
+}
+
+
+/**
+ * Page-out daemon. Swaps out pages until the number of free frames
+ * (including the ones which are currently written to the swap file)
+ * reaches the high watermark. This is called by the syscall loop
+ * after the reply to the current IPC has been sent.
+ */
+void pager_reclaim(void) {
+	heap_trim(); // unused heap frames are cheaper than any eviction
+
+	L4_Word_t available = frame_count_free() + swap_out_pending();
+	L4_Word_t before = available;
+
+	for(int i=0; i<RECLAIM_MAX_CLUSTERS && available < high_watermark; i++) {
+
+		int ret = swap_out(L4_nilthread, FALSE);
+		if(ret == NO_PAGE_AVAILABLE || ret == OUT_OF_SWAP_SPACE)
+			break;
+
+		available = frame_count_free() + swap_out_pending();
+	}
+
+	vm_stats.reclaim_runs++;
+	// swap_out may grow the heap, so there can be fewer free frames than before
+	if(available > before)
+		vm_stats.reclaim_pages += available - before;
+}
+
+
 /**
  * Unmaps the fpages in the kernel in a given range of virtual addresses.
+ * Only populated 2nd level tables are visited. Tables which lie
+ * completely within the range are unmapped with a single 1 MB fpage.
+ *
  * @param tid Thread ID which one to unmap
  * @param start First virtual address to unmap
- * @param end Last virtual address to unmap
+ * @param end Last virtual address to unmap (exclusive)
  */
 void pager_unmap_range(L4_ThreadId_t tid, L4_Word_t start, L4_Word_t end){
+	process* p = get_process(tid);
+	L4_Word_t i;
 
-	for(int i=0; i < FIRST_LEVEL_ENTRIES; i++) {
+	FOREACH_SECOND_LEVEL_TABLE(i, p, start, end) {
 		void* second_level_table = first_level_lookup(tid, i)->address_ptr;
+		L4_Word_t table_start = CREATE_VIRTUAL_ADDRESS(i, 0);
 
-		if(second_level_table != NULL) {
+		if(table_start >= start && table_start + (SECOND_LEVEL_ENTRIES << PAGESIZE_LOG2) <= end) {
+			dprintf(3, "Unmap for id:%X whole 2nd level table at 1st:%d (address %X)\n", tid, i, table_start);
 
-			for(int j=0; j < SECOND_LEVEL_ENTRIES; j++) {
+			if(L4_UnmapFpage(tid, L4_FpageLog2(table_start, SECOND_LEVEL_BITS + PAGESIZE_LOG2)) == 0) {
+				sos_print_error(L4_ErrorCode());
+				dprintf(0, "Can't unmap region at %lx\n", table_start);
+			}
 
-				page_table_entry* pte = second_level_lookup(second_level_table, j);
-				L4_Word_t virtual_address = CREATE_VIRTUAL_ADDRESS(i,j);
+			continue;
+		}
 
-				if(virtual_address >= start && virtual_address < end && pte->address_ptr != NULL && !IS_SWAPPED(pte->address)) {
-					dprintf(3, "Unmap for id:%X at 1st:%d 2nd:%d which corresponds to address %X\n", tid, i, j, virtual_address);
+		for(int j=0; j < SECOND_LEVEL_ENTRIES; j++) {
 
-					if(L4_UnmapFpage(tid, L4_FpageLog2(virtual_address, PAGESIZE_LOG2)) == 0) {
-						sos_print_error(L4_ErrorCode());
-						dprintf(0, "Can't unmap page at %lx\n", virtual_address);
-					} // else success
+			page_table_entry* pte = second_level_lookup(second_level_table, j);
+			L4_Word_t virtual_address = CREATE_VIRTUAL_ADDRESS(i,j);
 
-				} // else no 2nd level entry here
+			if(virtual_address >= start && virtual_address < end && pte->address_ptr != NULL && !IS_SWAPPED(pte->address)) {
+				dprintf(3, "Unmap for id:%X at 1st:%d 2nd:%d which corresponds to address %X\n", tid, i, j, virtual_address);
 
-			}
+				if(L4_UnmapFpage(tid, L4_FpageLog2(virtual_address, PAGESIZE_LOG2)) == 0) {
+					sos_print_error(L4_ErrorCode());
+					dprintf(0, "Can't unmap page at %lx\n", virtual_address);
+				} // else success
+
+			} // else no 2nd level entry here
 
-		} // else no 1st level entry here
+		}
 
 	}
 
@@ -500,152 +1266,230 @@ void pager_unmap_range(L4_ThreadId_t tid, L4_Word_t start, L4_Word_t end){
 }
 
 /**
- * Unmaps all mappings the initializer process made
- * in the physical address space.
- * @param tid
+ * Cleans and invalidates the cache lines of user pages. This writes
+ * back what the user wrote through its (cached) mapping so the root
+ * server sees it in the frame, and makes sure the user does not read
+ * stale lines once the root server changed the frame.
+ * Needs to be done before a page is unmapped or the root server
+ * accesses the frame of a mapped page.
+ *
+ * @param tid owner of the page
+ * @param addr virtual address of the page
+ * @param size number of bytes (multiple of PAGESIZE)
  */
-void pager_unmap_initializer(L4_ThreadId_t tid){
+void pager_cache_flush(L4_ThreadId_t tid, L4_Word_t addr, L4_Word_t size) {
+#ifdef USER_MAPPINGS_CACHED
+	addr = CLEAR_LOWER_BITS(addr);
+	L4_CacheFlushRange(tid, addr, addr+size);
+#endif
+}
 
-	for(int i=0x710000; i < VIRTUAL_START; i+=PAGESIZE) {
 
-		if(L4_UnmapFpage(tid, L4_FpageLog2(i, PAGESIZE_LOG2)) == 0) {
-			dprintf(0, "Can't unmap page at %lx (error:%d)\n", i, L4_ErrorCode());
-		} // else success
+/**
+ * Releases the frame or swap slot a page table entry points to.
+ *
+ * @param pte page table entry
+ * @return TRUE if the entry was in use
+ */
+static L4_Bool_t release_entry(page_table_entry* pte) {
+	L4_Word_t address = pte->address;
 
+	if(address == 0)
+		return FALSE;
+
+	// the zero page is not owned by the process
+	if(address == zero_frame) {
+		pte->address_ptr = NULL;
+		return FALSE;
 	}
 
-	// make sure to flush the cache otherwise there might still be some mappings in the cache
-	L4_CacheFlushAll();
+	// cleared first, so shared pages don't count this process as user anymore
+	pte->address_ptr = NULL;
+
+	if(IS_SWAPPED(address))
+		swap_free(CLEAR_LOWER_BITS(address));
+	else
+		swap_release(CLEAR_LOWER_BITS(address));
 
+	return TRUE;
 }
 
 
 /**
  * Frees the allocated space for the page table for a given thread.
- * In addition this frees all queue items currently in the active
- * pages queue for a given process and frees the allocated swap space
+ * In addition this frees all frames and the allocated swap space
  * of the process.
+ * Only the populated 2nd level tables of the process are visited,
+ * so the cost does not depend on the size of the address space or
+ * the other processes in the system.
  * This should be called after a thread has finished executing.
  *
  * @param tid thread id
  */
 void pager_free_all(L4_ThreadId_t tid) {
+	process* p = get_process(tid);
+	L4_Word_t i;
 
 	// free allocated 2nd level pagetables and free currently swapped out entries in swap file
-	for(int i=0; i<FIRST_LEVEL_ENTRIES; i++) {
-
+	FOREACH_SECOND_LEVEL_TABLE(i, p, 0, STACK_TOP+1) {
 		void* second_level_table = first_level_lookup(tid, i)->address_ptr;
-		if(second_level_table != NULL) {
-
-			for(int j=0; j < SECOND_LEVEL_ENTRIES; j++) {
-				page_table_entry* pte = second_level_lookup(second_level_table, j);
 
-				if(IS_SWAPPED(pte->address)) {
-					swap_free(CLEAR_LOWER_BITS(pte->address));
-				}
-
-				else if(pte->address_ptr != NULL) {
-					frame_free(CLEAR_LOWER_BITS(pte->address));
-				}
-
-				pte->address_ptr = NULL;
-				get_process(tid)->size -= 1;
-			}
-
-			free(second_level_table);
-			second_level_table = NULL;
+		for(int j=0; j < SECOND_LEVEL_ENTRIES; j++) {
+			if(release_entry(second_level_lookup(second_level_table, j)))
+				p->size -= 1;
 		}
 
+		free_second_level_table(p, i);
 	}
 
-	// free page queue items and remove them from active queue, also free their
-	// corresponding swap space (if available)
-    for(page_queue_item* page = active_pages_head.tqh_first; page != NULL;) {
-    	page_queue_item* next = page->entries.tqe_next;
-
-    	if(L4_IsThreadEqual(tid, page->tid)) {
-
-			TAILQ_REMOVE(&active_pages_head, page, entries);
-			if(page->swap_offset != -1)
-				swap_free(page->swap_offset);
-			free(page);
-    	}
-
-    	page = next;
-    }
-
-    // make sure to correctly cancel all ongoing swapping operations for this process
-    for(page_queue_item* page = swapping_pages_head.tqh_first; page != NULL; page = page->entries.tqe_next) {
-    	if(L4_IsThreadEqual(tid, page->tid)) {
-			page->process_deleted = TRUE;
-    	}
-    	if(L4_IsThreadEqual(tid, page->initiator)) {
-    		page->initiator = L4_nilthread; // means we don't call back in swap out
-    	}
-    }
-
+	// make sure swap out clusters don't restart this thread anymore
+	swap_cancel(tid);
 }
 
 
+/**
+ * Frees all pages of a thread in a given range of virtual addresses.
+ * 2nd level tables which lie completely within the range are freed
+ * as well.
+ *
+ * @param tid thread id
+ * @param start first virtual address
+ * @param end last virtual address (exclusive)
+ */
 void pager_free_range(L4_ThreadId_t tid, L4_Word_t start, L4_Word_t end) {
+	process* p = get_process(tid);
+	L4_Word_t i;
 
 	// free allocated 2nd level pagetables and free currently swapped out entries in swap file
-	for(int i=0; i<FIRST_LEVEL_ENTRIES; i++) {
-
+	FOREACH_SECOND_LEVEL_TABLE(i, p, start, end) {
 		void* second_level_table = first_level_lookup(tid, i)->address_ptr;
-		if(second_level_table != NULL) {
+		L4_Word_t table_start = CREATE_VIRTUAL_ADDRESS(i, 0);
+
+		for(int j=0; j < SECOND_LEVEL_ENTRIES; j++) {
+			L4_Word_t virtual_address = CREATE_VIRTUAL_ADDRESS(i,j);
 
-			for(int j=0; j < SECOND_LEVEL_ENTRIES; j++) {
-				L4_Word_t virtual_address = CREATE_VIRTUAL_ADDRESS(i,j);
+			if(virtual_address >= start && virtual_address < end)
+				release_entry(second_level_lookup(second_level_table, j));
+		}
 
-				if(virtual_address >= start && virtual_address < end) {
-					page_table_entry* pte = second_level_lookup(second_level_table, j);
+		if(table_start >= start && table_start + (SECOND_LEVEL_ENTRIES << PAGESIZE_LOG2) <= end)
+			free_second_level_table(p, i);
+	}
+}
 
-					if(IS_SWAPPED(pte->address)) {
-						swap_free(CLEAR_LOWER_BITS(pte->address));
-					}
 
-					else if(pte->address_ptr != NULL) {
-						frame_free(CLEAR_LOWER_BITS(pte->address));
-					}
+/**
+ * Copies the address space of a process into the (empty) page table
+ * of a clone. Resident pages are shared copy on write, swapped out
+ * pages share their swap slot. The IPC page and the zero page are not
+ * copied, the clone gets a new one on its first syscall respectively
+ * faults on the zero page again.
+ * All mappings of the parent are removed, so it faults on the next
+ * write to a now shared page as well.
+ *
+ * @param parent thread ID of the process to clone
+ * @param child thread ID of the clone
+ */
+void pager_clone(L4_ThreadId_t parent, L4_ThreadId_t child) {
+	process* p = get_process(parent);
+	process* c = get_process(child);
+	L4_Word_t i;
+
+	// also writes back the cache lines of the parent
+	pager_unmap_range(parent, 0, STACK_TOP);
+
+	FOREACH_SECOND_LEVEL_TABLE(i, p, 0, STACK_TOP+1) {
+		page_table_entry* second_level_table = first_level_lookup(parent, i)->address_ptr;
+
+		for(int j=0; j < SECOND_LEVEL_ENTRIES; j++) {
+			page_table_entry* pte = second_level_lookup(second_level_table, j);
 
-					pte->address_ptr = NULL;
-				}
+			if(pte->address_ptr == NULL)
+				continue;
 
+			if(IS_SWAPPED(pte->address)) {
+				swap_dup(CLEAR_LOWER_BITS(pte->address));
+			}
+			else if(frame_entry(CLEAR_LOWER_BITS(pte->address))->flags & FRAME_PINNED) {
+				continue;
+			}
+			else if((frame_entry(CLEAR_LOWER_BITS(pte->address))->flags & FRAME_SWAPPING) &&
+					frame_entry(CLEAR_LOWER_BITS(pte->address))->cluster == NULL) {
+				// a page still read ahead can't be shared yet, the clone
+				// shares its swap slot (a parent calling clone can't wait
+				// for a page itself)
+				assert(frame_entry(CLEAR_LOWER_BITS(pte->address))->flags & FRAME_PREFETCH);
+				int swap_offset = frame_entry(CLEAR_LOWER_BITS(pte->address))->swap_offset;
+
+				swap_dup(swap_offset);
+				if(first_level_lookup(child, i)->address_ptr == NULL)
+					create_second_level_table(c, i);
+
+				second_level_lookup(first_level_lookup(child, i)->address_ptr, j)->address = swap_offset | 0x1;
+				c->size += 1;
+				continue;
+			}
+			else {
+				swap_share(CLEAR_LOWER_BITS(pte->address));
 			}
 
-		}
+			if(first_level_lookup(child, i)->address_ptr == NULL)
+				create_second_level_table(c, i);
 
+			second_level_lookup(first_level_lookup(child, i)->address_ptr, j)->address = pte->address;
+			c->size += 1;
+		}
 	}
 
-	// free page queue items and remove them from active queue, also free their
-	// corresponding swap space (if available)
-    for(page_queue_item* page = active_pages_head.tqh_first; page != NULL;) {
+	vm_stats.clones++;
+}
+
+
+/**
+ * Replaces a resident anonymous page which only contains zeros by the
+ * zero page (see merge.c). The page needs to be unmapped.
+ *
+ * @param tid owner of the page
+ * @param addr virtual address of the page
+ * @return TRUE if the frame of the page was freed
+ */
+L4_Bool_t pager_merge_zero(L4_ThreadId_t tid, L4_Word_t addr) {
+	if(!is_anonymous(tid, addr))
+		return FALSE;
 
-    	page_queue_item* next = page->entries.tqe_next;
+	page_table_entry* pte = pager_table_lookup(tid, addr);
+	assert(pte != NULL && pte->address_ptr != NULL && !IS_SWAPPED(pte->address));
 
-    	if(L4_IsThreadEqual(tid, page->tid) && page->virtual_address >= start && page->virtual_address < end) {
+	L4_Word_t frame = CLEAR_LOWER_BITS(pte->address);
+	pte->address = zero_frame;
+	swap_release(frame);
+	get_process(tid)->size -= 1;
 
-			TAILQ_REMOVE(&active_pages_head, page, entries);
-			if(page->swap_offset != -1)
-				swap_free(page->swap_offset);
-			free(page);
+	return TRUE;
+}
 
-    	}
 
-    	page = next;
-    }
+/**
+ * Lets a resident page use a frame with the same contents instead of
+ * its own (see merge.c). The frame is shared copy on write from now
+ * on, the page needs to be unmapped. The frame has to hold the page
+ * of the same virtual address in another process (see swap_unshare).
+ *
+ * @param tid owner of the page
+ * @param addr virtual address of the page
+ * @param frame frame with the same contents
+ */
+void pager_merge(L4_ThreadId_t tid, L4_Word_t addr, L4_Word_t frame) {
+	page_table_entry* pte = pager_table_lookup(tid, addr);
+	assert(pte != NULL && pte->address_ptr != NULL && !IS_SWAPPED(pte->address));
 
-    // make sure to correctly cancel all ongoing swapping operations for this process
-    for(page_queue_item* page = swapping_pages_head.tqh_first; page != NULL; page = page->entries.tqe_next) {
-    	if(L4_IsThreadEqual(tid, page->tid) && page->virtual_address >= start && page->virtual_address < end) {
-			page->process_deleted = TRUE;
-    	}
-    	if(L4_IsThreadEqual(tid, page->initiator) && page->virtual_address >= start && page->virtual_address < end) {
-    		page->initiator = L4_nilthread; // means we don't call back in swap out
-    	}
-    }
+	L4_Word_t old_frame = CLEAR_LOWER_BITS(pte->address);
+	assert(old_frame != frame);
+	assert(frame_entry(frame)->virtual_address == addr && !L4_IsThreadEqual(frame_entry(frame)->tid, tid));
 
+	swap_share(frame);
+	pte->address = frame;
+	swap_release(old_frame);
 }
 
 
@@ -657,7 +1501,7 @@ void pager_free_range(L4_ThreadId_t tid, L4_Word_t start, L4_Word_t end) {
  */
 void* pager_physical_lookup(L4_ThreadId_t tid, L4_Word_t addr) {
 	page_table_entry* first_entry = first_level_lookup(tid, FIRST_LEVEL_INDEX(addr));
-	if(first_entry == NULL)
+	if(first_entry == NULL || first_entry->address_ptr == NULL)
 		return NULL;
 
 	page_table_entry* second_entry = second_level_lookup(first_entry->address_ptr, SECOND_LEVEL_INDEX(addr));
@@ -674,7 +1518,7 @@ void* pager_physical_lookup(L4_ThreadId_t tid, L4_Word_t addr) {
  */
 page_table_entry* pager_table_lookup(L4_ThreadId_t tid, L4_Word_t addr) {
 	page_table_entry* first_entry = first_level_lookup(tid, FIRST_LEVEL_INDEX(addr));
-	if(first_entry->address_ptr == NULL)
+	if(first_entry == NULL || first_entry->address_ptr == NULL)
 		return NULL;
 
 	return second_level_lookup(first_entry->address_ptr, SECOND_LEVEL_INDEX(addr));
@@ -25,13 +25,16 @@ typedef struct page_entry {
 #define DATA_END (DATA_START + 4*ONE_MEGABYTE)
 
 #define STACK_TOP 0xC0000000
-#define STACK_END (STACK_TOP - ONE_MEGABYTE)
+#define STACK_END (STACK_TOP - 16*ONE_MEGABYTE)			/**< Lowest address the stack can grow to */
+#define STACK_INITIAL_SIZE ONE_MEGABYTE					/**< Stack accessible right from the start */
+#define STACK_GROWTH_GAP (64*1024)						/**< Faults this far below the stack grow it */
 
 #define IPC_START 0x60000000
 #define IPC_END (IPC_START + 4096)
 
 #define HEAP_START 0x40000000
-#define HEAP_END (HEAP_START + (4 * ONE_MEGABYTE))
+#define HEAP_END (HEAP_START + 256*ONE_MEGABYTE)		/**< Upper bound for all heap limits */
+#define HEAP_DEFAULT_LIMIT (64*ONE_MEGABYTE)			/**< Heap limit of a new process */
 
 // Page table manipulation macros and constants
 #define FIRST_LEVEL_BITS 12
@@ -39,19 +42,44 @@ typedef struct page_entry {
 #define SECOND_LEVEL_BITS 8
 #define SECOND_LEVEL_ENTRIES (1 << SECOND_LEVEL_BITS)
 
+/** Number of 1 MB regions (1st level entries) touched by [start, end) */
+#define REGION_COUNT(start, end) ((((end) - 1) >> 20) - ((start) >> 20) + 1)
+/** Entries in the page index of a process, one per 1 MB region of the layout which can hold pages */
+#define PAGE_INDEX_ENTRIES (REGION_COUNT(TEXT_START, DATA_END) + REGION_COUNT(HEAP_START, HEAP_END) + \
+							REGION_COUNT(IPC_START, IPC_END) + REGION_COUNT(STACK_END, STACK_TOP))
+/** Number of words in the bitmap of populated 2nd level tables */
+#define PAGE_TABLE_BITMAP_WORDS ((PAGE_INDEX_ENTRIES + 31) / 32)
+
+/** Counters of the virtual memory subsystem (see vm_shared.h) */
+extern vm_stats_t vm_stats;
+
 void pager_init(void);
 int pager(L4_ThreadId_t, L4_Msg_t*);
+int pager_stats(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf);
+int pager_set_watermarks(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf);
+int pager_sbrk(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf);
+int pager_set_heap_limit(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf);
+int pager_set_frame_quota(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf);
+
+L4_Bool_t pager_reclaim_needed(void);
+void pager_reclaim(void);
 
 int pager_unmap_all(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf);
 void pager_free_all(L4_ThreadId_t);
-void pager_unmap_initializer(L4_ThreadId_t);
+page_table_entry* pager_alloc_page_index(void);
+void pager_free_page_index(page_table_entry*);
 
 void pager_unmap_range(L4_ThreadId_t, L4_Word_t start, L4_Word_t end);
+void pager_clone(L4_ThreadId_t parent, L4_ThreadId_t child);
 void pager_free_range(L4_ThreadId_t, L4_Word_t start, L4_Word_t end);
+L4_Bool_t pager_merge_zero(L4_ThreadId_t, L4_Word_t addr);
+void pager_merge(L4_ThreadId_t, L4_Word_t addr, L4_Word_t frame);
 
+void pager_cache_flush(L4_ThreadId_t, L4_Word_t addr, L4_Word_t size);
 void* pager_physical_lookup(L4_ThreadId_t, L4_Word_t addr);
 page_table_entry* pager_table_lookup(L4_ThreadId_t, L4_Word_t);
 
 #define CLEAR_LOWER_BITS(addr) ((addr) & ~0xFFF)
+#define ROUND_UP_PAGE(addr) CLEAR_LOWER_BITS((addr) + 0xFFF)
 
 #endif /* PAGER_H_ */
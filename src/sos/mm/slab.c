@@ -0,0 +1,222 @@
+/**
+ * Slab Allocator
+ * =============
+ * Most of the metadata of the root server consists of fixed size
+ * objects which are allocated and freed all the time (second level
+ * page tables, file descriptors, alarm timers, RPC queue items, swap
+ * requests and compressed page entries). The
+ * K&R malloc walks its free list on every call which gets slower the
+ * more the heap is fragmented. So these objects come from object
+ * caches instead, one cache per type.
+ *
+ * Slabs
+ * ------------------------------
+ * A cache gets its memory in slabs of about SLAB_SIZE bytes from
+ * malloc. A slab starts with a header followed by its objects. Every
+ * object is preceded by a pointer to its slab, so slab_free finds the
+ * slab (and the cache) in constant time. Free objects of a slab are
+ * kept in a singly linked list which lives in the objects themselves.
+ *
+ * The cache keeps all slabs which have at least one free object in
+ * its partial list. Allocation takes an object from the first slab
+ * in it and drops the slab from the list once it is full. A slab which
+ * gets a free object again goes to the front, a slab which becomes
+ * completely free to the back. So allocations fill up partially used
+ * slabs first and empty slabs can be handed back to malloc. Up to
+ * SLAB_SPARE empty slabs are kept per cache so a cache alternating
+ * between allocation and free does not hit malloc each time.
+ *
+ * Allocation and free are therefore O(1) unless a new slab is needed
+ * or an empty one is released.
+ *
+ * Statistics
+ * ------------------------------
+ * Every cache counts its used objects, slabs and allocations. Caches
+ * are linked into a list on their first use and reported by the
+ * vm_stats syscall (see slab_stats).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sos_shared.h>
+
+#include "../libsos.h"
+#include "slab.h"
+
+#define verbose 1
+
+/** Approximate size of a slab (header and objects) */
+#define SLAB_SIZE 4096
+/** Number of empty slabs a cache keeps instead of freeing them */
+#define SLAB_SPARE 1
+/** Objects are aligned to this (same as malloc) */
+#define SLAB_ALIGN 8
+
+#define ROUND_UP(x, align) (((x) + (align) - 1) & ~((align) - 1))
+
+/** Header at the start of every slab */
+typedef struct slab {
+	TAILQ_ENTRY(slab) entries;		/**< Links the slab into the partial list of its cache */
+	slab_cache* cache;				/**< Cache the slab belongs to */
+	void* free_list;				/**< First free object */
+	unsigned used;					/**< Number of allocated objects */
+} slab;
+
+/** Size of the slab header, objects start behind it */
+#define SLAB_HEADER_SIZE ROUND_UP(sizeof(slab), SLAB_ALIGN)
+
+/** Every object is preceded by the address of its slab */
+#define OBJECT_HEADER_SIZE SLAB_ALIGN
+#define OBJECT_SLAB(object) (*(slab**) ((char*) (object) - OBJECT_HEADER_SIZE))
+
+/** Free objects contain the address of the next free object */
+#define NEXT_FREE(object) (*(void**) (object))
+
+static slab_cache* caches = NULL;	/**< All caches which have been used */
+
+
+/**
+ * Sets up a cache on its first allocation.
+ *
+ * @param cache the cache
+ */
+static void cache_setup(slab_cache* cache) {
+	assert(cache->size > 0);
+
+	cache->stride = OBJECT_HEADER_SIZE + ROUND_UP(max(cache->size, sizeof(void*)), SLAB_ALIGN);
+	cache->per_slab = max((SLAB_SIZE - SLAB_HEADER_SIZE) / cache->stride, 1);
+	TAILQ_INIT(&cache->partial);
+
+	cache->next_cache = caches;
+	caches = cache;
+}
+
+
+/**
+ * Allocates a new slab for a cache and puts all its objects
+ * in the free list of the slab.
+ *
+ * @param cache the cache
+ * @return the new slab or NULL if the heap is exhausted
+ */
+static slab* slab_create(slab_cache* cache) {
+	slab* s = malloc(SLAB_HEADER_SIZE + cache->per_slab * cache->stride);
+	if(s == NULL)
+		return NULL;
+
+	s->cache = cache;
+	s->used = 0;
+	s->free_list = NULL;
+
+	char* objects = (char*) s + SLAB_HEADER_SIZE;
+	for(int i=cache->per_slab-1; i>=0; i--) {
+		void* object = objects + i*cache->stride + OBJECT_HEADER_SIZE;
+		OBJECT_SLAB(object) = s;
+		NEXT_FREE(object) = s->free_list;
+		s->free_list = object;
+	}
+
+	cache->slabs++;
+	cache->grows++;
+	cache->empty_slabs++;
+	TAILQ_INSERT_HEAD(&cache->partial, s, entries);
+
+	dprintf(2, "%s: new slab for %s (%d objects)\n", __FUNCTION__, cache->name, cache->per_slab);
+	return s;
+}
+
+
+/**
+ * Allocates an object from a cache. The contents of the
+ * object are undefined.
+ *
+ * @param cache the cache
+ * @return the object or NULL if the heap is exhausted
+ */
+void* slab_alloc(slab_cache* cache) {
+	if(cache->stride == 0)
+		cache_setup(cache);
+
+	slab* s = TAILQ_FIRST(&cache->partial);
+	if(s == NULL && (s = slab_create(cache)) == NULL)
+		return NULL;
+
+	void* object = s->free_list;
+	assert(object != NULL && OBJECT_SLAB(object) == s);
+	s->free_list = NEXT_FREE(object);
+
+	if(s->used++ == 0)
+		cache->empty_slabs--;
+	if(s->free_list == NULL)
+		TAILQ_REMOVE(&cache->partial, s, entries);
+
+	cache->objects_used++;
+	cache->allocs++;
+
+	return object;
+}
+
+
+/**
+ * Returns an object to its cache.
+ *
+ * @param object object allocated by slab_alloc (may be NULL)
+ */
+void slab_free(void* object) {
+	if(object == NULL)
+		return;
+
+	slab* s = OBJECT_SLAB(object);
+	slab_cache* cache = s->cache;
+	assert(s->used > 0);
+
+	if(s->free_list == NULL)
+		TAILQ_INSERT_HEAD(&cache->partial, s, entries); // was full
+
+	NEXT_FREE(object) = s->free_list;
+	s->free_list = object;
+	cache->objects_used--;
+
+	if(--s->used > 0)
+		return;
+
+	// slab is empty, keep it as a spare or give it back
+	TAILQ_REMOVE(&cache->partial, s, entries);
+	if(cache->empty_slabs < SLAB_SPARE) {
+		TAILQ_INSERT_TAIL(&cache->partial, s, entries);
+		cache->empty_slabs++;
+	}
+	else {
+		cache->slabs--;
+		free(s);
+	}
+}
+
+
+/**
+ * Fills in the statistics of the caches used so far.
+ *
+ * @param stats array to fill in
+ * @param max_caches number of elements in stats
+ * @return number of caches reported
+ */
+int slab_stats(slab_stats_t* stats, int max_caches) {
+	int count = 0;
+
+	for(slab_cache* cache = caches; cache != NULL && count < max_caches; cache = cache->next_cache, count++) {
+		slab_stats_t* s = &stats[count];
+
+		strncpy(s->name, cache->name, sizeof(s->name) - 1);
+		s->name[sizeof(s->name) - 1] = '\0';
+		s->object_size = cache->size;
+		s->objects_used = cache->objects_used;
+		s->objects_total = cache->slabs * cache->per_slab;
+		s->slabs = cache->slabs;
+		s->bytes = cache->slabs * (SLAB_HEADER_SIZE + cache->per_slab * cache->stride);
+		s->allocs = cache->allocs;
+		s->grows = cache->grows;
+	}
+
+	return count;
+}
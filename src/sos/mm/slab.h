@@ -0,0 +1,39 @@
+#ifndef SLAB_H_
+#define SLAB_H_
+
+#include <stddef.h>
+#include "../queue.h"
+
+struct slab;
+struct slab_stats;
+
+TAILQ_HEAD(slab_list, slab);
+
+/** Object cache for objects of one fixed size (see slab.c) */
+typedef struct slab_cache {
+	const char* name;				/**< Shown in the statistics */
+	size_t size;					/**< Size of the objects */
+
+	size_t stride;					/**< Distance between two objects in a slab (0 until first use) */
+	unsigned per_slab;				/**< Objects per slab */
+	struct slab_list partial;		/**< Slabs with at least one free object */
+	unsigned empty_slabs;			/**< Slabs in partial without any used object */
+	struct slab_cache* next_cache;	/**< Links all caches in use for the statistics */
+
+	unsigned objects_used;			/**< Objects currently allocated */
+	unsigned slabs;					/**< Slabs currently allocated from the heap */
+	unsigned allocs;				/**< Number of allocations so far */
+	unsigned grows;					/**< Allocations which needed a new slab */
+} slab_cache;
+
+/**
+ * Static initializer for a cache of objects of a given type,
+ * the cache is set up on its first allocation.
+ */
+#define SLAB_CACHE_INITIALIZER(name, type) { (name), sizeof(type) }
+
+void* slab_alloc(slab_cache* cache);
+void slab_free(void* object);
+int slab_stats(struct slab_stats* stats, int max_caches);
+
+#endif /* SLAB_H_ */
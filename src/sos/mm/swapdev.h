@@ -0,0 +1,34 @@
+#ifndef SWAPDEV_H_
+#define SWAPDEV_H_
+
+#include <l4/types.h>
+
+/** Status passed to swap_io_callback */
+#define SWAP_IO_OK 0
+#define SWAP_IO_NOSPC 1
+#define SWAP_IO_ERROR 2
+
+/** Called once a read or write of a backend has completed */
+typedef void (*swap_io_callback)(void* token, int status);
+
+/**
+ * Operations of a swap backend (see swapdev_nfs.c, swapdev_ram.c).
+ * Offsets are page aligned byte offsets of swap slots. Reads and
+ * writes always complete asynchronously, i.e. the callback is never
+ * called before read_page/write_page returned.
+ */
+typedef struct swap_backend {
+	const char* name;
+	L4_Word_t (*init)(void);											/**< prepares the backend, returns its capacity in slots (0 if unlimited) */
+	void (*read_page)(int offset, L4_Word_t frame, swap_io_callback done, void* token);	/**< reads a slot into a frame */
+	void (*write_page)(int offset, L4_Word_t frame, swap_io_callback done, void* token);	/**< writes a frame to a slot */
+	void (*trim)(int offset);											/**< the contents of a slot are not needed anymore */
+} swap_backend;
+
+extern swap_backend nfs_swap_backend;
+extern swap_backend ram_swap_backend;
+
+/** Backend used by the swapper */
+extern swap_backend* swap_device;
+
+#endif /* SWAPDEV_H_ */
@@ -0,0 +1,200 @@
+/**
+ * NFS Swap Backend
+ * =============
+ * Stores swap slots in the file called swap on the NFS server (opened
+ * by io_init as SWAP_FD of the root server). NFS requests carry at
+ * most BATCH_SIZE bytes, so a page is written with PAGESIZE/BATCH_SIZE
+ * write requests which are all sent at once. Reads are issued one
+ * after another since every reply is copied into the frame anyway.
+ * The swap file grows automatically when we write behind its end.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <sos_shared.h>
+
+#include "../l4.h"
+#include "../libsos.h"
+#include "../process.h"
+#include "../io/io.h"
+#include "pager.h"
+#include "swapper.h"
+#include "swapdev.h"
+#include "slab.h"
+
+#define verbose 1
+
+/** Amount of bytes read/written from/to swap file per call */
+#define BATCH_SIZE 512
+
+/** Read or write of a page in progress */
+typedef struct nfs_swap_request {
+	int offset;					/**< swap slot */
+	L4_Word_t frame;			/**< frame read into / written from */
+	int bytes;					/**< bytes read so far / still to write */
+	swap_io_callback done;		/**< called once the page is completed */
+	void* token;				/**< passed to done */
+} nfs_swap_request;
+
+/** Object cache for the requests (see slab.c) */
+static slab_cache nfs_swap_request_cache = SLAB_CACHE_INITIALIZER("nfs swap io", nfs_swap_request);
+
+
+/**
+ * Returns the file table entry of the swap file.
+ */
+static file_table_entry* swap_file(void) {
+	file_table_entry* swap_fd = get_process(root_thread_g)->filetable[SWAP_FD];
+	assert(swap_fd != NULL);
+
+	return swap_fd;
+}
+
+
+/**
+ * Creates a request. Every request is freed once its callback is done.
+ */
+static nfs_swap_request* create_request(int offset, L4_Word_t frame, swap_io_callback done, void* token) {
+	nfs_swap_request* request = slab_alloc(&nfs_swap_request_cache);
+	assert(request != NULL);
+
+	request->offset = offset;
+	request->frame = frame;
+	request->bytes = 0;
+	request->done = done;
+	request->token = token;
+
+	return request;
+}
+
+
+/**
+ * Write callback of the NFS library, called once for every BATCH_SIZE
+ * part of the page.
+ *
+ * @param token request
+ * @param status NFS status
+ * @param attr attributes of the swap file
+ */
+static void nfs_swap_write_callback(uintptr_t token, int status, fattr_t *attr) {
+	nfs_swap_request* request = (nfs_swap_request*) token;
+
+	switch (status) {
+		case NFS_OK:
+		{
+			// update file attributes
+			file_table_entry* swap_fd = swap_file();
+			swap_fd->file->status.st_size = attr->size;
+			swap_fd->file->status.st_atime = attr->atime.useconds / 1000;
+
+			request->bytes -= BATCH_SIZE;
+			if(request->bytes == 0) {
+				request->done(request->token, SWAP_IO_OK);
+				slab_free(request);
+			}
+		}
+		break;
+
+		case NFSERR_NOSPC:
+			request->done(request->token, SWAP_IO_NOSPC);
+		break;
+
+		default:
+			dprintf(0, "%s: Bad NFS status (%d) from callback.\n", __FUNCTION__, status);
+			request->done(request->token, SWAP_IO_ERROR);
+		break;
+	}
+
+}
+
+
+/**
+ * Read callback of the NFS library. Copies the data into the frame
+ * and asks for the next part of the page.
+ *
+ * @param token request
+ * @param status NFS status
+ * @param bytes_read should always be BATCH_SIZE
+ * @param data pointer to the data
+ */
+static void nfs_swap_read_callback(uintptr_t token, int status, fattr_t *attr, int bytes_read, char *data) {
+	nfs_swap_request* request = (nfs_swap_request*) token;
+
+	if(status != NFS_OK) {
+		dprintf(0, "%s: Bad NFS status (%d) from callback.\n", __FUNCTION__, status);
+		request->done(request->token, SWAP_IO_ERROR);
+		return;
+	}
+
+	assert(bytes_read == BATCH_SIZE);
+	memcpy((char*) request->frame + request->bytes, data, bytes_read);
+	request->bytes += bytes_read;
+
+	if(request->bytes == PAGESIZE) {
+		request->done(request->token, SWAP_IO_OK);
+		slab_free(request);
+	}
+	else {
+		nfs_read(&swap_file()->file->nfs_handle, request->offset + request->bytes, BATCH_SIZE, &nfs_swap_read_callback, (int)request);
+	}
+
+}
+
+
+/**
+ * The swap file is opened by io_init later on, so there's nothing
+ * to do here. NFS gives us as much space as the swap map allows.
+ */
+static L4_Word_t nfs_swap_init(void) {
+	return 0;
+}
+
+
+/**
+ * Reads a page from the swap file.
+ */
+static void nfs_swap_read_page(int offset, L4_Word_t frame, swap_io_callback done, void* token) {
+	nfs_swap_request* request = create_request(offset, frame, done, token);
+
+	nfs_read(&swap_file()->file->nfs_handle, offset, BATCH_SIZE, &nfs_swap_read_callback, (int)request);
+}
+
+
+/**
+ * Writes a page to the swap file. All requests are issued at once.
+ */
+static void nfs_swap_write_page(int offset, L4_Word_t frame, swap_io_callback done, void* token) {
+	nfs_swap_request* request = create_request(offset, frame, done, token);
+	request->bytes = PAGESIZE;
+
+	assert(PAGESIZE % BATCH_SIZE == 0);
+	for(int write_offset=0; write_offset < PAGESIZE; write_offset += BATCH_SIZE) {
+		nfs_write(
+			&swap_file()->file->nfs_handle,
+			offset + write_offset,
+			BATCH_SIZE,
+			(data_ptr) frame + write_offset,
+			&nfs_swap_write_callback,
+			(int)request
+		);
+		vm_stats.swap_write_rpcs++;
+	}
+
+}
+
+
+/**
+ * NFS has no way to punch holes into a file, freed slots are just
+ * overwritten later on.
+ */
+static void nfs_swap_trim(int offset) {
+}
+
+
+swap_backend nfs_swap_backend = {
+	"nfs",
+	&nfs_swap_init,
+	&nfs_swap_read_page,
+	&nfs_swap_write_page,
+	&nfs_swap_trim
+};
@@ -0,0 +1,187 @@
+/**
+ * RAM Swap Backend
+ * =============
+ * Stores swap slots in frames reserved at start-up instead of a file,
+ * so the page replacement can be measured without the network. Slot
+ * n lives in the n-th reserved frame, the swap map is limited to the
+ * number of reserved frames.
+ * Requests complete RAMSWAP_LATENCY microseconds after they were
+ * issued (a timer alarm completes them in order), which keeps the
+ * callbacks asynchronous like the ones of a real device and allows to
+ * simulate devices of different speed. The clock runs alarms due
+ * within CLOCK_ALARM_SLACK right away, so the alarm completes every
+ * request due within that window as well instead of rearming itself
+ * for a few microseconds; latencies below the slack are not simulated.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sos_shared.h>
+#include <clock.h>
+
+#include "../l4.h"
+#include "../libsos.h"
+#include "swapdev.h"
+#include "frames.h"
+#include "slab.h"
+
+#define verbose 1
+
+/** Maximum number of frames reserved for swap slots */
+#define RAMSWAP_FRAMES 256
+/** Time in microseconds a request takes */
+#define RAMSWAP_LATENCY 100
+
+/** Read or write waiting for its completion */
+typedef struct ram_swap_request {
+	int offset;						/**< swap slot */
+	L4_Word_t frame;				/**< frame read into / written from */
+	L4_Bool_t write;				/**< TRUE for writes */
+	timestamp_t ready;				/**< time the request completes */
+	swap_io_callback done;			/**< called once the request completed */
+	void* token;					/**< passed to done */
+	struct ram_swap_request* next;	/**< next request in issue order */
+} ram_swap_request;
+
+/** Object cache for the requests (see slab.c) */
+static slab_cache ram_swap_request_cache = SLAB_CACHE_INITIALIZER("ram swap io", ram_swap_request);
+
+static L4_Word_t* slots = NULL;				/**< reserved frame of each slot */
+static L4_Word_t slot_count = 0;
+
+static ram_swap_request* queue_head = NULL;	/**< oldest pending request */
+static ram_swap_request* queue_tail = NULL;
+static L4_Bool_t completing = FALSE;		/**< TRUE while ram_swap_complete calls back */
+
+
+/**
+ * Returns the frame holding a slot.
+ */
+static L4_Word_t slot_frame(int offset) {
+	assert(offset % PAGESIZE == 0 && offset / PAGESIZE < slot_count);
+
+	return slots[offset / PAGESIZE];
+}
+
+
+/**
+ * Timer alarm which completes all requests whose time has come (or
+ * comes within CLOCK_ALARM_SLACK).
+ * Rearms itself while there are requests left (including the ones
+ * queued by the callbacks).
+ *
+ * @param owner root thread
+ * @param status unused
+ */
+static void ram_swap_complete(L4_ThreadId_t owner, int status) {
+	timestamp_t now = get_time_stamp();
+	completing = TRUE;
+
+	while(queue_head != NULL && queue_head->ready <= now + CLOCK_ALARM_SLACK) {
+		ram_swap_request* request = queue_head;
+		queue_head = request->next;
+		if(queue_head == NULL)
+			queue_tail = NULL;
+
+		if(request->write)
+			memcpy((void*) slot_frame(request->offset), (void*) request->frame, PAGESIZE);
+		else
+			memcpy((void*) request->frame, (void*) slot_frame(request->offset), PAGESIZE);
+
+		request->done(request->token, SWAP_IO_OK);
+		slab_free(request);
+	}
+
+	completing = FALSE;
+	if(queue_head != NULL) {
+		int ret = register_alarm(queue_head->ready - now, owner, &ram_swap_complete);
+		assert(ret == CLOCK_R_OK);
+	}
+
+}
+
+
+/**
+ * Queues a request. The alarm is only armed for the first request in
+ * the queue, all others complete later than that one. Requests queued
+ * while the alarm completes others are picked up when it rearms.
+ */
+static void queue_request(int offset, L4_Word_t frame, L4_Bool_t write, swap_io_callback done, void* token) {
+	ram_swap_request* request = slab_alloc(&ram_swap_request_cache);
+	assert(request != NULL);
+
+	request->offset = offset;
+	request->frame = frame;
+	request->write = write;
+	request->ready = get_time_stamp() + RAMSWAP_LATENCY;
+	request->done = done;
+	request->token = token;
+	request->next = NULL;
+
+	if(queue_tail == NULL) {
+		queue_head = queue_tail = request;
+
+		if(!completing) {
+			int ret = register_alarm(RAMSWAP_LATENCY, root_thread_g, &ram_swap_complete);
+			assert(ret == CLOCK_R_OK);
+		}
+	}
+	else {
+		queue_tail->next = request;
+		queue_tail = request;
+	}
+
+}
+
+
+/**
+ * Reserves the frames for the slots (a quarter of the free frames at
+ * most, rounded down to a multiple of 32).
+ *
+ * @return number of slots
+ */
+static L4_Word_t ram_swap_init(void) {
+	// the swap map manages slots in words of 32
+	slot_count = min(RAMSWAP_FRAMES, frame_count_free() / 4) & ~31;
+	assert(slot_count > 0 && "Not enough free frames for the RAM swap backend");
+
+	slots = malloc(slot_count * sizeof(L4_Word_t));
+	assert(slots != NULL);
+
+	for(L4_Word_t i=0; i<slot_count; i++) {
+		slots[i] = frame_alloc();
+		assert(slots[i] != 0);
+		frame_entry(slots[i])->flags = FRAME_PINNED;
+	}
+
+	dprintf(0, "Swapping to %d reserved frames\n", slot_count);
+	return slot_count;
+}
+
+
+static void ram_swap_read_page(int offset, L4_Word_t frame, swap_io_callback done, void* token) {
+	queue_request(offset, frame, FALSE, done, token);
+}
+
+
+static void ram_swap_write_page(int offset, L4_Word_t frame, swap_io_callback done, void* token) {
+	queue_request(offset, frame, TRUE, done, token);
+}
+
+
+/**
+ * Slots are overwritten by the next write, nothing to do.
+ */
+static void ram_swap_trim(int offset) {
+	assert(offset / PAGESIZE < slot_count);
+}
+
+
+swap_backend ram_swap_backend = {
+	"ram",
+	&ram_swap_init,
+	&ram_swap_read_page,
+	&ram_swap_write_page,
+	&ram_swap_trim
+};
@@ -0,0 +1,277 @@
+/**
+ * Swap Space Map
+ * =============
+ * Keeps track of which slots (page sized areas) in the swap file are
+ * in use. The map is a bitmap which is processed a word at a time
+ * (32 slots per word). On top of it there is a summary bitmap with one
+ * bit per word which is set if the word is completely used. Finding a
+ * free slot therefore only needs to look at 1/1024 of the map in the
+ * summary plus one word. Runs of consecutive slots (used for swap out
+ * clusters) are found by skipping over full words and counting empty
+ * words as 32 free slots at once.
+ *
+ * The map starts with SWAPMAP_INITIAL_SLOTS slots and doubles its size
+ * whenever it runs full, up to SWAPMAP_MAX_SLOTS or the capacity of the
+ * swap backend if it has a fixed size (see swapdev.h).
+ * The upper limit is given by the page table entries which store the
+ * swap offset in their upper 20 bits and by the NFS offsets which are
+ * signed 32 bit integers.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sos_shared.h>
+
+#include "../libsos.h"
+#include "swapmap.h"
+
+#define verbose 1
+
+/** Number of slots the map is created with (4 MB of swap) */
+#define SWAPMAP_INITIAL_SLOTS 1024
+/** Upper limit for the number of slots (2 GB of swap) */
+#define SWAPMAP_MAX_SLOTS (1 << 19)
+
+#define BITS_PER_WORD 32
+#define FULL_WORD 0xFFFFFFFF
+
+#define WORD_INDEX(slot) ((slot) / BITS_PER_WORD)
+#define BIT_MASK(slot) (1UL << ((slot) % BITS_PER_WORD))
+
+static L4_Word_t* map = NULL;		/**< One bit per slot, set if used */
+static L4_Word_t* summary = NULL;	/**< One bit per map word, set if the word is full */
+static L4_Word_t map_words = 0;		/**< Number of words in map */
+static L4_Word_t used_slots = 0;	/**< Number of slots currently in use */
+static L4_Word_t max_slots = 0;		/**< The map does not grow beyond this */
+
+
+/**
+ * Number of words needed for the summary of a map with
+ * `words` words.
+ */
+static L4_Word_t summary_words(L4_Word_t words) {
+	return (words + BITS_PER_WORD - 1) / BITS_PER_WORD;
+}
+
+
+/**
+ * Updates the summary bit for a given word of the map.
+ *
+ * @param word index of the word in the map
+ */
+static void update_summary(L4_Word_t word) {
+	if(map[word] == FULL_WORD)
+		summary[WORD_INDEX(word)] |= BIT_MASK(word);
+	else
+		summary[WORD_INDEX(word)] &= ~BIT_MASK(word);
+}
+
+
+/**
+ * Marks a range of slots as used.
+ *
+ * @param first first slot
+ * @param slots number of slots
+ */
+static void mark_used(L4_Word_t first, L4_Word_t slots) {
+	for(L4_Word_t slot=first; slot<first+slots; slot++) {
+		assert(!(map[WORD_INDEX(slot)] & BIT_MASK(slot)));
+		map[WORD_INDEX(slot)] |= BIT_MASK(slot);
+		update_summary(WORD_INDEX(slot));
+	}
+
+	used_slots += slots;
+}
+
+
+/**
+ * Doubles the size of the map (and the summary). New slots are free.
+ *
+ * @return TRUE if the map could grow, FALSE if we're at the limit
+ * or out of memory
+ */
+static L4_Bool_t grow(void) {
+	L4_Word_t new_words = map_words * 2;
+	if(new_words * BITS_PER_WORD > max_slots)
+		return FALSE;
+
+	L4_Word_t* new_map = realloc(map, new_words * sizeof(L4_Word_t));
+	if(new_map == NULL)
+		return FALSE;
+	map = new_map;
+	memset(map + map_words, 0, (new_words - map_words) * sizeof(L4_Word_t));
+
+	L4_Word_t old_summary = summary_words(map_words);
+	L4_Word_t* new_summary = realloc(summary, summary_words(new_words) * sizeof(L4_Word_t));
+	if(new_summary == NULL)
+		return FALSE; // map is bigger than needed but still consistent with the old summary
+	summary = new_summary;
+	memset(summary + old_summary, 0, (summary_words(new_words) - old_summary) * sizeof(L4_Word_t));
+
+	dprintf(1, "Swap map grows from %d to %d slots\n", map_words * BITS_PER_WORD, new_words * BITS_PER_WORD);
+	map_words = new_words;
+
+	return TRUE;
+}
+
+
+/**
+ * Finds a single free slot by looking at the summary first.
+ *
+ * @return slot number or -1 if the map is full
+ */
+static int find_free_slot(void) {
+
+	for(L4_Word_t s=0; s<summary_words(map_words); s++) {
+		if(summary[s] == FULL_WORD)
+			continue;
+
+		L4_Word_t word = s * BITS_PER_WORD + __builtin_ctz(~summary[s]);
+		if(word >= map_words)
+			break;
+
+		return word * BITS_PER_WORD + __builtin_ctz(~map[word]);
+	}
+
+	return -1;
+}
+
+
+/**
+ * Finds a run of `slots` consecutive free slots.
+ *
+ * @param slots length of the run
+ * @return first slot of the run or -1 if there is none
+ */
+static int find_free_run(L4_Word_t slots) {
+	L4_Word_t run = 0;
+	L4_Word_t run_start = 0;
+
+	for(L4_Word_t word=0; word<map_words; word++) {
+
+		if(map[word] == FULL_WORD) {
+			run = 0;
+			continue;
+		}
+
+		if(map[word] == 0) {
+			if(run == 0)
+				run_start = word * BITS_PER_WORD;
+			run += BITS_PER_WORD;
+		}
+		else {
+			for(L4_Word_t bit=0; bit<BITS_PER_WORD && run < slots; bit++) {
+				if(map[word] & (1UL << bit)) {
+					run = 0;
+				}
+				else {
+					if(run == 0)
+						run_start = word * BITS_PER_WORD + bit;
+					run++;
+				}
+			}
+		}
+
+		if(run >= slots)
+			return run_start;
+	}
+
+	return -1;
+}
+
+
+/**
+ * Initializes the swap map.
+ *
+ * @param slots initial number of slots (rounded up to a multiple of 32)
+ * @param limit maximum number of slots (0 for SWAPMAP_MAX_SLOTS)
+ */
+void swapmap_init(L4_Word_t slots, L4_Word_t limit) {
+	max_slots = (limit == 0) ? SWAPMAP_MAX_SLOTS : limit;
+
+	if(slots == 0)
+		slots = min(SWAPMAP_INITIAL_SLOTS, max_slots);
+
+	map_words = (slots + BITS_PER_WORD - 1) / BITS_PER_WORD;
+	used_slots = 0;
+
+	map = malloc(map_words * sizeof(L4_Word_t));
+	assert(map != NULL);
+	memset(map, 0, map_words * sizeof(L4_Word_t));
+
+	summary = malloc(summary_words(map_words) * sizeof(L4_Word_t));
+	assert(summary != NULL);
+	memset(summary, 0, summary_words(map_words) * sizeof(L4_Word_t));
+}
+
+
+/**
+ * Allocates `slots` consecutive slots in the swap file. The map
+ * grows if there is no place for them.
+ *
+ * @param slots number of slots needed (> 0)
+ * @return first allocated slot or -1 if swap is full
+ */
+int swapmap_alloc(int slots) {
+	assert(slots > 0);
+
+	do {
+		int first = (slots == 1) ? find_free_slot() : find_free_run(slots);
+
+		if(first >= 0) {
+			mark_used(first, slots);
+			return first;
+		}
+
+	} while(grow());
+
+	return -1;
+}
+
+
+/**
+ * Frees a slot in the swap file.
+ *
+ * @param slot slot number
+ */
+void swapmap_free(int slot) {
+	assert(slot >= 0 && WORD_INDEX(slot) < map_words);
+	assert(map[WORD_INDEX(slot)] & BIT_MASK(slot));
+
+	map[WORD_INDEX(slot)] &= ~BIT_MASK(slot);
+	update_summary(WORD_INDEX(slot));
+	used_slots--;
+}
+
+
+/**
+ * Returns if a given slot is in use.
+ *
+ * @param slot slot number
+ * @return TRUE if used
+ */
+L4_Bool_t swapmap_get(int slot) {
+	assert(slot >= 0);
+
+	if(WORD_INDEX(slot) >= map_words)
+		return FALSE;
+
+	return (map[WORD_INDEX(slot)] & BIT_MASK(slot)) != 0;
+}
+
+
+/**
+ * @return number of slots currently in use
+ */
+L4_Word_t swapmap_used(void) {
+	return used_slots;
+}
+
+
+/**
+ * @return current size of the map in slots
+ */
+L4_Word_t swapmap_size(void) {
+	return map_words * BITS_PER_WORD;
+}
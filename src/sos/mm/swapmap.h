@@ -0,0 +1,14 @@
+#ifndef SWAPMAP_H_
+#define SWAPMAP_H_
+
+#include <l4/types.h>
+
+void swapmap_init(L4_Word_t slots, L4_Word_t limit);
+int swapmap_alloc(int slots);
+void swapmap_free(int slot);
+L4_Bool_t swapmap_get(int slot);
+
+L4_Word_t swapmap_used(void);
+L4_Word_t swapmap_size(void);
+
+#endif /* SWAPMAP_H_ */
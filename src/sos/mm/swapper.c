@@ -3,152 +3,726 @@
  * =============
  * Swapping uses a file called swap in our filesystem to temporary
  * store pages once we run out of free frames. We implemented a
- * second chance page replacement algorithm to select which page
+ * two-handed clock page replacement algorithm to select which page
  * should be swapped out. This file provides 2 functions
  * swap_out and swap_in responsible for writing a page to the swap
  * file and reading it back in a frame. These functions are called
  * by the pager (see pager.c).
  *
- * Second Chance Implementation
+ * Swap Out Clustering
  * ------------------------------
- * In addition to our software page table we use a queue containing
- * the current set of active pages in the system. second_chance_select
- * uses the queue to select a page for swapping out.
+ * Instead of evicting a single page per fault swap_out selects up to
+ * SWAP_CLUSTER_SIZE victims at once. Clean victims are freed right away,
+ * dirty ones form a cluster which is laid out in consecutive swap slots
+ * (sorted by virtual address) and all write requests of the cluster are
+ * sent to NFS without waiting for each other. The faulting thread is
+ * restarted as soon as the first frame is free again. If a clean page
+ * could be freed immediately it does not have to wait at all and the
+ * cluster is written behind its back. Setting SWAP_CLUSTER_SIZE to 1
+ * gives the old one page per fault behaviour.
+ *
+ * Clock Implementation
+ * ------------------------------
+ * The clock sweeps over the core map (see frames.c) which holds the
+ * page currently living in each frame. Only entries marked as tracked
+ * (resident user pages which are not pinned, shared or being swapped) are
+ * considered. Two hands sweep over this array CLOCK_HAND_SPREAD
+ * frames apart. The front hand
+ * takes away the reference bit of the pages it passes, the back hand
+ * evicts pages which have not been referenced again since then.
+ * Unreferenced clean pages are taken right away since they don't need
+ * any IO. Unreferenced dirty pages are only taken if no clean one shows
+ * up within CLOCK_MAX_SCAN pages, so the work per eviction is bounded.
+ * The number of pages the back hand looked at is accounted in the vm
+ * statistics.
+ * Pages of a large page (see pager.c) are tracked one by one, but the
+ * whole large page is unmapped when one of them is dereferenced. The
+ * large page is split up once one of its pages is evicted or freed.
  *
  * Reference and Dirty Bits
  * ------------------------------
  * Since the ARM CPU does not provide any reference or dirty bit we
- * emulated them in software. So set/unset the reference bit
- * corresponds to mapping/unmapping the corresponding fpage.
- * The dirty bit is regarded as set as soon as a page is mapped with
- * write access into the pagetable.
+ * emulated them in software and keep them in the core map. The
+ * reference bit is set by the pager whenever it maps the page and
+ * cleared by unmapping the fpage, so a page is referenced again exactly
+ * when it faulted in the mean time.
+ * The dirty bit is set as soon as a page is mapped with write access
+ * and cleared when the page is sent to the swap file. Pages read back
+ * from swap are clean: they are mapped with the rights of the fault
+ * (a read fault maps them read-only), keep their swap slot as a valid
+ * copy and only become dirty on their first write fault. Evicting a
+ * clean page needs no IO at all, these avoided writes are counted in
+ * the vm statistics. Text pages loaded from an executable are clean
+ * without a swap slot (swap_track_text): they are never written, so
+ * evicting one just clears its page table entry and the next fault
+ * gets it from the text cache or the file again (see loader.c).
  *
  * Pagetable Modifications
  * ------------------------------
  * We need know - when reading out page table entries - if a page is
- * currently swapped out or if it's dirty.
+ * currently swapped out.
  * As soon as a page is swapped out the 1st bit in the page table is set
  * to 1 (Note: the lower 12 bits in the pagetable are never used anyways
  * by addresses). If this bit is one, the upper area of the entry stores
  * the offset were the page is located in the swap file.
- * A page is marked as dirty in the pagetable if the second bit is set.
+ *
+ * Frames which are being read or written by NFS are never freed while
+ * the IO is in progress. If the owner is deleted in the mean time the
+ * frame is only marked and freed by the callback.
+ *
+ * Shared Pages
+ * ------------------------------
+ * Frames can be mapped by more than one process, either as text page
+ * of the same executable (see loader.c) or after process_clone as copy
+ * on write page (see pager.c). Such frames are marked as shared, count
+ * their users in the core map and are taken out of the clock, since
+ * evicting them would require to update the page tables of all users.
+ * Once only one user is left (swap_unshare) the page goes back into the
+ * clock under the name of this user.
+ * Swapped out pages of a cloned process share their swap slot in the
+ * same way (swap_dup). The users of shared slots are counted in a small
+ * hash table. A page swapped in from a shared slot keeps its share of
+ * the slot as a clean copy. Only once it is dirty and evicted again it
+ * lets go of the slot and gets one of its own, since the other users
+ * still need the old contents.
+ *
+ * Working Sets and Quotas
+ * ------------------------------
+ * The front hand counts the referenced pages it passes per process.
+ * At the end of each revolution this count becomes the working set
+ * estimate of the process, i.e. the pages it used within one
+ * revolution of the clock. The resident pages in the clock are
+ * counted per process as well (track/untrack).
+ * A process can be given a frame quota. Once its resident pages reach
+ * the quota, a fault of the process evicts one of its own pages
+ * (local_select) instead of taking a frame from everyone else, so a
+ * process which thrashes can't push the working sets of other
+ * processes out. Processes without a quota use global replacement.
+ *
+ * Compressed Pool
+ * ------------------------------
+ * Before a dirty page of a cluster is written it is offered to the
+ * compressed pool (see zswap.c). If it fits, the page is evicted right
+ * away like a clean page and the pool writes it to its swap slot later
+ * on, oldest pages first. swap_in asks the pool before reading from
+ * the swap file, a hit completes the fault without waiting for NFS.
+ *
+ * Swap Backends
+ * ------------------------------
+ * The swapper does not know where swap slots are stored. It reads and
+ * writes whole pages through the operations of a swap backend (see
+ * swapdev.h) which call back once the IO is done. SWAP_BACKEND selects
+ * the swap file on NFS (swapdev_nfs.c) or frames reserved at start-up
+ * (swapdev_ram.c, to measure page replacement without the network).
+ * Backends with a fixed size limit the swap map.
  *
  * Swap File Layout
  * ------------------------------
  * The swap file contains the swapped out pages. Page are one after another
  * in the file (each page is 4096 bytes large). The entries of a swap file
- * are tracked using a bitfield. The maximum size of the swap file is
- * controlled by MAX_SWAP_ENTRIES. As a default value this is set to
- * 5000. So this means we can swap out MAX_SWAP_ENTRIES pages which limits
- * the maximum size of the swap file to PAGESIZE*MAX_SWAP_ENTRIES.
+ * are tracked by the swap map (see swapmap.c) which finds free entries
+ * and runs of free entries quickly and grows on demand.
  *
  **/
 
 #include <assert.h>
 #include <string.h>
 #include <sos_shared.h>
+#include <clock.h>
 
 #include "../l4.h"
 #include "../libsos.h"
 #include "../process.h"
 #include "../io/io.h"
-#include "../datastructures/bitfield.h"
+#include "swapmap.h"
 #include "swapper.h"
+#include "zswap.h"
+#include "swapdev.h"
+#include "loader.h"
 #include "frames.h"
+#include "slab.h"
 
 #define verbose 1
 
-/** Amount of bytes read/written from/to swap file per call */
-#define BATCH_SIZE 512
-/** Maximum number of entries the swap file can hold (note this should be a multiple of 8 for the bitfield) */
-#define MAX_SWAP_ENTRIES 5000
-static data_ptr swap_bitfield;
+/** Backend the swap slots are stored in (nfs_swap_backend or ram_swap_backend) */
+#define SWAP_BACKEND nfs_swap_backend
+/** Maximum number of pages evicted by a single swap_out call */
+#define SWAP_CLUSTER_SIZE 8
+/** Distance in frames between the front and the back hand of the clock */
+#define CLOCK_HAND_SPREAD 64
+/** Number of pages the back hand looks at before it settles for a dirty page */
+#define CLOCK_MAX_SCAN 32
+/** Number of hash buckets for swap slots used by more than one process */
+#define SHARED_SLOT_BUCKETS 64
+/** Number of pages currently being written to the swap file */
+static int pages_in_flight = 0;
 
-struct pages_head active_pages_head;
 struct pages_head swapping_pages_head;
 
+swap_backend* swap_device;
+
+static L4_Word_t clock_size;			/**< Number of entries in the core map */
+static L4_Word_t clock_spread;			/**< Actual hand spread (smaller than clock_size) */
+static L4_Word_t back_hand;				/**< Current position of the back hand */
+static L4_Word_t local_hand;			/**< Current position of the local replacement scan */
+
+/** Swap slot used by more than one process */
+typedef struct shared_slot {
+	int offset;						/**< Offset of the slot in the swap file */
+	int users;						/**< Number of page table entries pointing to it */
+	struct shared_slot* next;		/**< Next entry in the same bucket */
+} shared_slot;
+
+static shared_slot* shared_slots[SHARED_SLOT_BUCKETS];
+
+/** Object caches for shared slots and clusters (see slab.c) */
+static slab_cache shared_slot_cache = SLAB_CACHE_INITIALIZER("shared slot", shared_slot);
+static slab_cache swap_cluster_cache = SLAB_CACHE_INITIALIZER("swap cluster", swap_cluster);
+
+
+/**
+ * Returns the start address of the frame a core map entry
+ * belongs to.
+ *
+ * @param page core map entry
+ * @return frame address
+ */
+static L4_Word_t page_frame(core_map_entry* page) {
+	return frame_address(page - core_map);
+}
+
 
 /**
  * Check if a page is dirty (has been written to).
  * @param page
  * @return 1 If page was written, 0 otherwise
  */
-static L4_Bool_t is_dirty(page_queue_item* page) {
+static L4_Bool_t is_dirty(core_map_entry* page) {
 	assert(page != NULL);
-
-	page_table_entry* pte = pager_table_lookup(page->tid, page->virtual_address);
-	assert(pte != NULL);
-
-	return (L4_Word_t)pte->address_ptr & 0x2;
+	return (page->flags & FRAME_DIRTY) != 0;
 }
 
 
 /**
- * Checks if a page has been referenced. This works by querying
- * the L4 pagetable. If the page is mapped in there we say it's
- * referenced.
+ * Checks if a page has been referenced, i.e. if it has been
+ * mapped again by the pager since it was last dereferenced.
  * @param page
  * @return 1 If page was referenced, 0 otherwise
  */
-static L4_Bool_t is_referenced(page_queue_item* page) {
-	L4_Fpage_t fpage = L4_FpageLog2(page->virtual_address, PAGESIZE_LOG2);
-	L4_PhysDesc_t phys;
+static L4_Bool_t is_referenced(core_map_entry* page) {
+	assert(page != NULL);
+	return (page->flags & FRAME_REFERENCED) != 0;
+}
 
-	if(L4_GetStatus(page->tid, &fpage, &phys) == FALSE) {
-		dprintf(0, "Can't get status for page 0x%X (error:%d)\n", page->virtual_address, L4_ErrorCode());
-	}
 
-	return L4_WasReferenced(fpage);
+/**
+ * Puts a page into the clock and counts it as resident page of
+ * its owner.
+ * @param page page with a valid owner
+ */
+static void track(core_map_entry* page) {
+	assert(!(page->flags & FRAME_TRACKED));
+
+	page->flags |= FRAME_TRACKED;
+	get_process(page->tid)->resident++;
+}
+
+
+/**
+ * Takes a page out of the clock.
+ * @param page tracked page
+ */
+static void untrack(core_map_entry* page) {
+	assert(page->flags & FRAME_TRACKED);
+
+	page->flags &= ~FRAME_TRACKED;
+	get_process(page->tid)->resident--;
+}
+
+
+/**
+ * Returns the core map entry of the first page of the large page
+ * a page belongs to.
+ *
+ * @param page page with FRAME_LARGE set
+ * @return first core map entry of the large page
+ */
+static core_map_entry* large_page_base(core_map_entry* page) {
+	assert(page->flags & FRAME_LARGE);
+	return frame_entry(page_frame(page) & ~(LARGE_PAGESIZE - 1));
+}
+
+
+/**
+ * Splits a large page up into independent pages. They stay mapped
+ * as a large fpage until they are dereferenced (which unmaps the
+ * whole region) and are mapped one by one afterwards.
+ *
+ * @param page any page of the large page
+ */
+static void break_large_page(core_map_entry* page) {
+	core_map_entry* base = large_page_base(page);
+
+	for(L4_Word_t i=0; i<PAGES_PER_LARGE_PAGE; i++)
+		base[i].flags &= ~FRAME_LARGE;
 
+	vm_stats.large_page_breaks++;
+}
+
+
+/**
+ * Frees the frame of a page which is not used anymore and removes
+ * it from the text cache if necessary (see loader.c).
+ * @param page
+ */
+static void free_page_frame(core_map_entry* page) {
+	if(page->flags & FRAME_TEXT)
+		loader_text_remove(page_frame(page));
+
+	if(page->flags & FRAME_TRACKED)
+		untrack(page);
+
+	page->flags = 0;
+	frame_free(page_frame(page));
 }
 
 
 /**
  * Dereferences a page. This just unmaps it in the L4 page table.
+ * Pages which are not referenced are not mapped anyway so we
+ * can save the system call for them. Pages mapped by fault-around
+ * are unmapped as well but never count as referenced. Large pages are unmapped
+ * as a whole and all their pages lose their reference bit.
  * @param page
  */
-static void dereference(page_queue_item* page) {
+static void dereference(core_map_entry* page) {
+
+	if(!(page->flags & (FRAME_REFERENCED | FRAME_SPECULATIVE)))
+		return;
+
+	L4_Word_t addr = page->virtual_address;
+	L4_Word_t size_log2 = PAGESIZE_LOG2;
+
+	if(page->flags & FRAME_LARGE) {
+		core_map_entry* base = large_page_base(page);
+		for(L4_Word_t i=0; i<PAGES_PER_LARGE_PAGE; i++)
+			base[i].flags &= ~FRAME_REFERENCED;
+
+		addr = base->virtual_address;
+		size_log2 = LARGE_PAGESIZE_LOG2;
+	}
+	else {
+		page->flags &= ~(FRAME_REFERENCED | FRAME_SPECULATIVE);
+	}
+
+	// write back what the user wrote before the mapping goes away
+	pager_cache_flush(page->tid, addr, 1UL << size_log2);
+
+	if(L4_UnmapFpage(page->tid, L4_FpageLog2(addr, size_log2)) == FALSE) {
+		dprintf(0, "Can't unmap page at 0x%X (error:%d)\n", addr, L4_ErrorCode());
+	}
+
+}
+
+
+/**
+ * Inserts a newly allocated page into the clock. New pages don't
+ * have a copy in the swap file and are therefore dirty.
+ *
+ * @param tid owner of the page
+ * @param addr virtual address of the page
+ * @param frame physical frame the page lives in
+ */
+void swap_track(L4_ThreadId_t tid, L4_Word_t addr, L4_Word_t frame) {
+	core_map_entry* page = frame_entry(frame);
+	assert(page->flags == 0);
+
+	page->tid = tid;
+	page->virtual_address = addr;
+	page->swap_offset = -1;
+	page->flags = FRAME_DIRTY | FRAME_REFERENCED;
+	track(page);
+}
+
+
+/**
+ * Inserts a text page which was just loaded from an executable into
+ * the clock. Text pages are read-only and the file holds a valid copy,
+ * so they are clean and don't get a swap slot.
+ *
+ * @param tid owner of the page
+ * @param addr virtual address of the page (within the text segment)
+ * @param frame physical frame the page lives in
+ */
+void swap_track_text(L4_ThreadId_t tid, L4_Word_t addr, L4_Word_t frame) {
+	assert(addr >= TEXT_START && addr < TEXT_END);
+
+	swap_track(tid, addr, frame);
+	frame_entry(frame)->flags &= ~FRAME_DIRTY;
+}
+
+
+/**
+ * Inserts a newly allocated large page into the clock. The pages
+ * are tracked one by one but are referenced together until the
+ * large page is broken up.
+ *
+ * @param tid owner of the pages
+ * @param addr virtual address of the large page (aligned to LARGE_PAGESIZE)
+ * @param frame first frame of the run backing the large page
+ */
+void swap_track_large(L4_ThreadId_t tid, L4_Word_t addr, L4_Word_t frame) {
+	assert(addr % LARGE_PAGESIZE == 0 && frame % LARGE_PAGESIZE == 0);
+
+	for(L4_Word_t i=0; i<PAGES_PER_LARGE_PAGE; i++) {
+		swap_track(tid, addr + i*PAGESIZE, frame + i*PAGESIZE);
+		frame_entry(frame + i*PAGESIZE)->flags |= FRAME_LARGE;
+	}
+
+}
+
+
+/**
+ * Adds a user to a frame which is mapped by more than one process.
+ * The first time a frame is shared it is taken out of the clock.
+ * Large pages are split up, so they can be shared page by page.
+ *
+ * @param frame frame of a resident page
+ */
+void swap_share(L4_Word_t frame) {
+	core_map_entry* page = frame_entry(frame);
+	assert(!(page->flags & (FRAME_PINNED | FRAME_DELETED)));
+
+	if(!(page->flags & FRAME_SHARED)) {
+		if(page->flags & FRAME_LARGE)
+			break_large_page(page);
+
+		if(page->flags & FRAME_TRACKED)
+			untrack(page);
+
+		page->flags |= FRAME_SHARED;
+		page->users = 1;
+		vm_stats.shared_frames++;
+	}
+
+	page->users++;
+}
+
+
+/**
+ * Drops one user of a shared frame. The page table entry of the
+ * process which lets go of the page needs to be cleared already.
+ * If only one user is left the page goes back into the clock
+ * (or the swap out which is in progress takes care of it).
+ *
+ * @param frame shared frame
+ */
+void swap_unshare(L4_Word_t frame) {
+	core_map_entry* page = frame_entry(frame);
+	assert(page->flags & FRAME_SHARED);
+
+	if(--page->users > 1)
+		return;
+
+	// find the remaining user, the page is tracked under its name
+	for(int i=1; i<MAX_RUNNING_PROCESS; i++) {
+		process* p = get_process(pid2tid(i));
+		if(!p->is_active)
+			continue;
+
+		page_table_entry* pte = pager_table_lookup(p->tid, page->virtual_address);
+		if(pte != NULL && pte->address == frame) {
+			page->tid = p->tid;
+			page->flags = (page->flags & ~FRAME_SHARED) | FRAME_REFERENCED;
+			if(!(page->flags & FRAME_SWAPPING))
+				track(page);
+
+			vm_stats.shared_frames--;
+			return;
+		}
+	}
+
+	assert(!"Remaining user of shared page not found");
+}
+
+
+/**
+ * Looks up a swap slot in the table of shared slots.
+ *
+ * @param offset offset of the slot in the swap file
+ * @return entry or NULL if the slot has only one user
+ */
+static shared_slot* shared_slot_lookup(int offset) {
+	shared_slot* slot;
+
+	for(slot = shared_slots[(offset / PAGESIZE) % SHARED_SLOT_BUCKETS]; slot != NULL; slot = slot->next) {
+		if(slot->offset == offset)
+			return slot;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Adds a user to a swap slot (for a swapped out page of a cloned
+ * process). The slot is only freed once all users freed it.
+ *
+ * @param offset offset of the slot in the swap file
+ */
+void swap_dup(int offset) {
+	assert(swap_get(offset));
+
+	shared_slot* slot = shared_slot_lookup(offset);
+	if(slot == NULL) {
+		slot = slab_alloc(&shared_slot_cache);
+		assert(slot != NULL);
+
+		slot->offset = offset;
+		slot->users = 1;
+		slot->next = shared_slots[(offset / PAGESIZE) % SHARED_SLOT_BUCKETS];
+		shared_slots[(offset / PAGESIZE) % SHARED_SLOT_BUCKETS] = slot;
+		vm_stats.shared_swap_slots++;
+	}
+
+	slot->users++;
+}
+
+
+/**
+ * Drops one user of a shared swap slot.
+ *
+ * @param offset offset of the slot in the swap file
+ * @return TRUE if the slot is still used by someone else,
+ * FALSE if it was not shared
+ */
+static L4_Bool_t shared_slot_release(int offset) {
+	shared_slot** entry = &shared_slots[(offset / PAGESIZE) % SHARED_SLOT_BUCKETS];
+
+	for(; *entry != NULL; entry = &(*entry)->next) {
+		if((*entry)->offset == offset) {
+			shared_slot* slot = *entry;
+
+			if(--slot->users == 1) {
+				*entry = slot->next;
+				slab_free(slot);
+				vm_stats.shared_swap_slots--;
+			}
+
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+
+/**
+ * Releases the frame of a resident page when its owner unmaps
+ * it or goes away. The swap copy of the page is freed as well.
+ * If the page is currently being swapped the frame is only marked
+ * and freed by the NFS callback once the IO is done.
+ *
+ * @param frame physical frame of the page
+ */
+void swap_release(L4_Word_t frame) {
+	core_map_entry* page = frame_entry(frame);
+
+	// shared pages are freed by their last user
+	if(page->flags & FRAME_SHARED) {
+		swap_unshare(frame);
+		return;
+	}
+
+	if(page->flags & FRAME_LARGE)
+		break_large_page(page);
+
+	if(page->flags & FRAME_SWAPPING) {
+		page->flags |= FRAME_DELETED;
+		return;
+	}
+
+	if(page->swap_offset != -1)
+		swap_free(page->swap_offset);
+
+	free_page_frame(page);
+}
+
+
+/**
+ * Makes sure no write cluster restarts a given thread once it's
+ * done. This is used if the thread is deleted.
+ *
+ * @param tid thread id
+ */
+void swap_cancel(L4_ThreadId_t tid) {
+	core_map_entry* page;
+
+	TAILQ_FOREACH(page, &swapping_pages_head, entries) {
+		if(page->cluster != NULL && L4_IsThreadEqual(tid, page->cluster->initiator))
+			page->cluster->initiator = L4_nilthread; // means we don't call back in swap out
+	}
+
+}
+
+
+/**
+ * Called whenever the front hand of the clock starts a new revolution.
+ * The pages of a process the front hand found referenced during the
+ * last revolution become its working set estimate.
+ */
+static void end_working_set_window(void) {
+
+	for(int i=1; i<MAX_RUNNING_PROCESS; i++) {
+		process* p = get_process(pid2tid(i));
+		if(!p->is_active)
+			continue;
+
+		p->working_set = p->referenced;
+		p->referenced = 0;
+	}
+
+}
+
+
+/**
+ * Takes a page selected for eviction out of the clock.
+ *
+ * @param selected page to evict
+ * @param scanned number of pages looked at to find it
+ */
+static void take_page(core_map_entry* selected, L4_Word_t scanned) {
+	// may still be mapped by fault-around
+	dereference(selected);
+	untrack(selected);
+
+	// large pages are evicted page by page
+	if(selected->flags & FRAME_LARGE)
+		break_large_page(selected);
+
+	// read ahead for nothing, the owner reads less ahead from now on
+	if(selected->flags & FRAME_PREFETCH) {
+		selected->flags &= ~FRAME_PREFETCH;
+		get_process(selected->tid)->readahead_window /= 2;
+		vm_stats.readahead_wasted++;
+	}
+
+	vm_stats.clock_evictions++;
+	vm_stats.clock_scanned += scanned;
+	vm_stats.clock_max_scan = max(vm_stats.clock_max_scan, scanned);
+}
 
-	if(L4_UnmapFpage(page->tid, L4_FpageLog2(page->virtual_address, PAGESIZE_LOG2)) == FALSE) {
-		dprintf(0, "Can't unmap page at 0x%X (error:%d)\n", page->virtual_address, L4_ErrorCode());
+
+/**
+ * Two-handed clock select implementation for choosing pages to
+ * swap out. The front hand dereferences pages, the back hand
+ * takes the first unreferenced clean page it finds. If it doesn't
+ * find one within CLOCK_MAX_SCAN pages the first unreferenced
+ * dirty page it passed is taken instead.
+ * In the worst case (no unreferenced page at all) this takes one
+ * full revolution plus the hand spread, since by then the front
+ * hand has dereferenced every page.
+ *
+ * @return selected page (no longer tracked by the clock) or NULL
+ * if there are no pages in the clock
+ */
+static core_map_entry* clock_select(void) {
+	core_map_entry* selected = NULL;
+	L4_Word_t scanned = 0;
+
+	for(L4_Word_t steps = 0; steps < clock_size + clock_spread; steps++) {
+
+		L4_Word_t front_hand = (back_hand + clock_spread) % clock_size;
+		if(front_hand == 0)
+			end_working_set_window();
+
+		core_map_entry* front = &core_map[front_hand];
+		if(front->flags & FRAME_TRACKED) {
+			if(is_referenced(front))
+				get_process(front->tid)->referenced++;
+			dereference(front);
+		}
+
+		core_map_entry* page = &core_map[back_hand];
+		back_hand = (back_hand + 1) % clock_size;
+
+		if(!(page->flags & FRAME_TRACKED))
+			continue;
+
+		scanned++;
+
+		if(!is_referenced(page)) {
+
+			if(!is_dirty(page)) {
+				selected = page;
+				break;
+			}
+			else if(selected == NULL) {
+				selected = page;
+			}
+
+		}
+
+		if(selected != NULL && scanned >= CLOCK_MAX_SCAN)
+			break;
 	}
 
-	//L4_CacheFlushRange(page->tid, pager_table_lookup(page->tid, page->virtual_address)->address, pager_table_lookup(page->tid, page->virtual_address)->address+PAGESIZE);
+	if(selected != NULL)
+		take_page(selected, scanned);
+
+	return selected;
 }
 
 
 /**
- * Second chance select implementation for choosing pages to
- * swap out. This will loop through the queue and find the
- * oldest unreferenced page.
- * Note: Since we use software emulated reference bits, in case
- * everything is mapped in the HW page table this degenerates
- * to pure FIFO.
+ * Selects a page of a single process for local replacement (see
+ * process quotas above). The pages of the process get a second
+ * chance: referenced ones are dereferenced, the first unreferenced
+ * clean page is taken or the first unreferenced dirty one if no clean
+ * page shows up within CLOCK_MAX_SCAN pages of the process.
+ * The scan continues where the last one stopped and covers the
+ * core map at most twice.
  *
- * @param page_queue
- * @return oldest unreferenced page (removed from the queue)
+ * @param owner process which has to give up a page
+ * @return selected page (no longer tracked by the clock) or NULL
+ * if the process has no pages in the clock
  */
-static page_queue_item* second_chance_select(struct pages_head* page_queue) {
+static core_map_entry* local_select(L4_ThreadId_t owner) {
+	core_map_entry* selected = NULL;
+	L4_Word_t scanned = 0;
+
+	if(get_process(owner)->resident == 0)
+		return NULL;
 
-	page_queue_item* page;
+	for(L4_Word_t steps = 0; steps < 2 * clock_size; steps++) {
 
-	// do a second chance search for a page over all currently active pages
-    for(page = page_queue->tqh_first; page != NULL; page = page_queue->tqh_first) {
+		core_map_entry* page = &core_map[local_hand];
+		local_hand = (local_hand + 1) % clock_size;
+
+		if(!(page->flags & FRAME_TRACKED) || !L4_IsThreadEqual(page->tid, owner))
+			continue;
+
+		scanned++;
+
+		if(is_referenced(page)) {
+			dereference(page);
+		}
+		else if(!is_dirty(page)) {
+			selected = page;
+			break;
+		}
+		else if(selected == NULL) {
+			selected = page;
+		}
 
-    	if(is_referenced(page)) {
-    		TAILQ_REMOVE(page_queue, page, entries); // remove oldest page
-    		dereference(page);
-    		TAILQ_INSERT_TAIL(page_queue, page, entries); // insert at front
-    	}
-    	else {
-    		// remove the page from the working set
-    		TAILQ_REMOVE(page_queue, page, entries);
-    		return page;
-    	}
+		if(selected != NULL && scanned >= CLOCK_MAX_SCAN)
+			break;
+	}
 
-    }
+	if(selected != NULL)
+		take_page(selected, scanned);
 
-    return NULL; // no pages in queue (bad)
+	return selected;
 }
 
 
@@ -168,83 +742,125 @@ static void mark_swapped(page_table_entry* pte, int swap_location) {
 
 
 /**
- * Write callback for the NFS write function in case we swap out.
- * Note that because we cannot write 4096 bytes in one chunk
- * we split the writes up in 512 byte chunks. So this function
- * is called multiple times by the NFS library.
+ * Frees the frame of a page whose content is in the swap file
+ * and points the page table entry to the swap location. Text pages
+ * without a swap location are dropped, the next fault loads them
+ * from the executable again.
  *
- * @param token pointer to the page queue item we are swapping out
+ * @param page page with a valid swap location or clean text page
  */
-static void swap_write_callback(uintptr_t token, int status, fattr_t *attr) {
-
-	page_queue_item* page = (page_queue_item*) token;
+static void evict_page(core_map_entry* page) {
 	page_table_entry* pte = pager_table_lookup(page->tid, page->virtual_address);
-	file_table_entry* swap_fd = get_process(root_thread_g)->filetable[SWAP_FD];
+	assert(pte != NULL);
+
+	if(page->swap_offset < 0) {
+		assert(!is_dirty(page) && page->virtual_address < TEXT_END);
+		pte->address_ptr = NULL;
+		get_process(page->tid)->size -= 1;
+	}
+	else {
+		mark_swapped(pte, page->swap_offset);
+	}
+
+	free_page_frame(page);
+}
+
+
+/**
+ * Frees a frame whose owner was deleted while it was being swapped,
+ * together with the swap space reserved for it.
+ *
+ * @param page deleted page
+ */
+static void free_deleted_page(core_map_entry* page) {
+	assert(page->flags & FRAME_DELETED);
+
+	if(page->swap_offset != -1)
+		swap_free(page->swap_offset);
+
+	free_page_frame(page);
+}
+
+
+/**
+ * Called whenever a page of a write cluster is completely written to
+ * the swap file. The thread which caused the swapping is restarted as
+ * soon as a frame is available again (or once we know the cluster could
+ * not free any frame, in which case it will just fault again).
+ *
+ * @param cluster the cluster the page belonged to
+ * @param frame_freed TRUE if the page frame has been freed
+ */
+static void cluster_page_done(swap_cluster* cluster, L4_Bool_t frame_freed) {
+	assert(cluster != NULL);
+	assert(cluster->pages_pending > 0);
+
+	cluster->pages_pending--;
+
+	if(!L4_IsNilThread(cluster->initiator) && (frame_freed || cluster->pages_pending == 0)) {
+		send_ipc_reply(cluster->initiator, L4_PAGEFAULT, 0);
+		cluster->initiator = L4_nilthread;
+	}
+
+	if(cluster->pages_pending == 0)
+		slab_free(cluster);
+}
+
+
+/**
+ * Called by the swap backend once a page has been written to its
+ * swap slot. The frame is freed unless the page was referenced in
+ * the mean time.
+ *
+ * @param token pointer to the core map entry we are swapping out
+ * @param status SWAP_IO_OK or an error of the backend
+ */
+static void swap_write_done(void* token, int status) {
+
+	core_map_entry* page = (core_map_entry*) token;
 
 	switch (status) {
-		case NFS_OK:
+		case SWAP_IO_OK:
 		{
-			// update file attributes
-			swap_fd->file->status.st_size = attr->size;
-			swap_fd->file->status.st_atime = attr->atime.useconds / 1000;
-
-			page->to_swap -= BATCH_SIZE;
-
-			// swapping complete, can we now finally free the frame?
-			if(page->to_swap == 0) {
-				if(!is_referenced(page)) {
-
-					dprintf(1, "page is swapped out\n");
-					if(!page->process_deleted) {
-						frame_free(CLEAR_LOWER_BITS(pte->address));
-						mark_swapped(pte, page->swap_offset);
-
-						// restart the thread who ran out of memory
-						if(!L4_IsNilThread(page->initiator))
-							send_ipc_reply(page->initiator, L4_PAGEFAULT, 0);
-					}
-					else {} // page was killed, nothing to do
-
-					TAILQ_REMOVE(&swapping_pages_head, page, entries);
-					free(page);
-
-				}
-				else {
-					dprintf(1, "page is swapped out but referenced in the mean time\n");
-					// page has been referenced inbetween swapping out
-					// we need to restart the whole swap procedure
-					TAILQ_REMOVE(&swapping_pages_head, page, entries);
-
-					if(!L4_IsNilThread(page->initiator)) {
-						send_ipc_reply(page->initiator, L4_PAGEFAULT, 0);
-					}
-
-					if(!page->process_deleted) {
-						page->initiator = L4_nilthread;
-						TAILQ_INSERT_TAIL(&active_pages_head, page, entries);
-					}
-					else {
-						free(page);
-					}
-
-				}
+			swap_cluster* cluster = page->cluster;
+			page->cluster = NULL;
+			page->flags &= ~FRAME_SWAPPING;
+			TAILQ_REMOVE(&swapping_pages_head, page, entries);
+			pages_in_flight--;
 
+			if(page->flags & FRAME_DELETED) {
+				// owner was killed in the mean time
+				free_deleted_page(page);
+				cluster_page_done(cluster, TRUE);
+			}
+			else if(!is_referenced(page) && !(page->flags & FRAME_SHARED)) {
+				dprintf(1, "page is swapped out\n");
+				evict_page(page);
+				cluster_page_done(cluster, TRUE);
+			}
+			else {
+				dprintf(1, "page is swapped out but referenced or shared in the mean time\n");
+				// page has been referenced inbetween swapping out
+				// so it goes back into the clock (it is clean unless
+				// it was written in the mean time), shared pages stay
+				// out of the clock
+				if(!(page->flags & FRAME_SHARED))
+					track(page);
+				cluster_page_done(cluster, FALSE);
 			}
 
 		}
 		break;
 
-		case NFSERR_NOSPC:
+		case SWAP_IO_NOSPC:
 			dprintf(0, "System ran out of memory _and_ swap space (this is bad).\n");
 			TAILQ_REMOVE(&swapping_pages_head, page, entries);
-			free(page);
 			assert(FALSE);
 		break;
 
 		default:
-			dprintf(0, "%s: Bad NFS status (%d) from callback.\n", __FUNCTION__, status);
+			dprintf(0, "%s: Swap backend %s failed (%d).\n", __FUNCTION__, swap_device->name, status);
 			TAILQ_REMOVE(&swapping_pages_head, page, entries);
-			free(page);
 			assert(FALSE);
 			// We could probably try to restart swapping here but since it failed before
 			// we don't see much point in this.
@@ -255,58 +871,65 @@ static void swap_write_callback(uintptr_t token, int status, fattr_t *attr) {
 
 
 /**
- * Read Callback for the NFS library if we're reading a page back into memory.
- * Again we split the NFS calls up and always read BATCH_SIZE bytes per call.
- * Note that once the page is competely swapped in it is inserted back into
- * the page queue which holds all the active pages at any given time.
+ * Called by the swap backend once a page is read back into memory.
+ * The page is inserted back into the clock and the faulting thread
+ * is restarted. Pages read ahead are not mapped and nobody waits for
+ * them, unless their owner faulted on them in the mean time (which
+ * clears FRAME_PREFETCH).
  *
- * @param token pointer to the page item
- * @param bytes_read should always be BATCH_SIZE
- * @param data pointer to the data
+ * @param token pointer to the core map entry
+ * @param status SWAP_IO_OK or an error of the backend
  */
-static void swap_read_callback(uintptr_t token, int status, fattr_t *attr, int bytes_read, char *data) {
+static void swap_read_done(void* token, int status) {
 
-	page_queue_item* page = (page_queue_item*) token;
-	page_table_entry* pte = pager_table_lookup(page->tid, page->virtual_address);
-	file_table_entry* swap_fd = get_process(root_thread_g)->filetable[SWAP_FD];
+	core_map_entry* page = (core_map_entry*) token;
 
-	if(page->process_deleted) {
+	if(page->flags & FRAME_DELETED) {
 		TAILQ_REMOVE(&swapping_pages_head, page, entries);
-		free(page);
+		page->flags &= ~FRAME_SWAPPING;
+		free_deleted_page(page);
 		return;
 	}
 
-	switch (status) {
-		case NFS_OK:
-		{
-			assert(bytes_read == BATCH_SIZE);
+	if(status != SWAP_IO_OK) {
+		dprintf(0, "%s: Swap backend %s failed (%d).\n", __FUNCTION__, swap_device->name, status);
+		assert(FALSE);
+		// We could probably try to restart swapping here but since it failed before
+		// we don't see much point in this.
+	}
 
-			memcpy( ((char*)pte->address_ptr)+page->to_swap, data, bytes_read);
-			page->to_swap += bytes_read;
+	// restart the thread because the page is in memory again
+	// the copy in the swap file stays valid until the page is written
+	// (for shared slots as well, see swap_out)
+	TAILQ_REMOVE(&swapping_pages_head, page, entries);
+	frame_cache_flush(page_frame(page));
+	page->flags = (page->flags & FRAME_PREFETCH) ? FRAME_PREFETCH : FRAME_REFERENCED;
+	track(page);
+
+	// only demand reads count for the fault latency
+	if(page->read_start != 0) {
+		vm_stats.zswap_misses++;
+		vm_stats.zswap_miss_us += (L4_Word_t) get_time_stamp() - page->read_start;
+	}
 
-			// swapping in complete
-			if(page->to_swap == PAGESIZE) {
-				// restart the thread because the page is in memory again
-				TAILQ_REMOVE(&swapping_pages_head, page, entries);
-	    		TAILQ_INSERT_TAIL(&active_pages_head, page, entries);
-				send_ipc_reply(page->tid, L4_PAGEFAULT, 0);
-			}
-			else {
-				// read next batch
-				nfs_read(&swap_fd->file->nfs_handle, page->swap_offset+page->to_swap, BATCH_SIZE, &swap_read_callback, (int)page);
-			}
+	if(!(page->flags & FRAME_PREFETCH))
+		send_ipc_reply(page->tid, L4_PAGEFAULT, 0);
+}
 
-		}
-		break;
 
-		default:
-			dprintf(0, "%s: Bad NFS status (%d) from callback.\n", __FUNCTION__, status);
-			assert(FALSE);
-			// We could probably try to restart swapping here but since it failed before
-			// we don't see much point in this.
-		break;
-	}
+/**
+ * Finds a run of `pages` consecutive empty places in the swap file.
+ *
+ * @param pages number of swap entries needed
+ * @return Start offset of the free run in swap file or -1 if
+ * there is no such run.
+ */
+static int allocate_swap_run(int pages) {
+	if(pages <= 0)
+		return -1;
 
+	int slot = swapmap_alloc(pages);
+	return (slot < 0) ? -1 : slot*PAGESIZE;
 }
 
 
@@ -317,16 +940,7 @@ static void swap_read_callback(uintptr_t token, int status, fattr_t *attr, int b
  * swap is full.
  */
 static int allocate_swap_entry(void) {
-
-	for(int i=0; i<MAX_SWAP_ENTRIES; i++) {
-
-		if(!bitfield_get(swap_bitfield, i)) {
-			bitfield_set(swap_bitfield, i, 1);
-			return i*PAGESIZE;
-		}
-	}
-
-	return -1;
+	return allocate_swap_run(1);
 }
 
 
@@ -337,27 +951,27 @@ static int allocate_swap_entry(void) {
 void swap_free(int offset) {
 	assert(offset % PAGESIZE == 0);
 
-	int bit_number = offset / PAGESIZE;
-	assert(bit_number <= MAX_SWAP_ENTRIES);
-	assert(bitfield_get(swap_bitfield, bit_number));
+	if(shared_slot_release(offset))
+		return;
+
+	// a slot still written back from the pool is freed by zswap afterwards
+	if(zswap_forget(offset))
+		return;
 
-	bitfield_set(swap_bitfield, bit_number, 0);
+	swap_device->trim(offset);
+	swapmap_free(offset / PAGESIZE);
 }
 
 
 /**
- * Returns the bitfield value of a given
- * swap offset.
+ * Returns if a given swap offset is in use.
  * @param offset
  * @return true or false
  */
 L4_Bool_t swap_get(int offset) {
 	assert(offset % PAGESIZE == 0);
 
-	int bit_number = offset / PAGESIZE;
-	assert(bit_number <= MAX_SWAP_ENTRIES);
-
-	return bitfield_get(swap_bitfield, bit_number);
+	return swapmap_get(offset / PAGESIZE);
 }
 
 
@@ -366,81 +980,233 @@ L4_Bool_t swap_get(int offset) {
  * This is called by pager_init.
  */
 void swap_init() {
-	TAILQ_INIT(&active_pages_head);
 	TAILQ_INIT(&swapping_pages_head);
 
-	// initialize the bitfield for the swap file
-	swap_bitfield = malloc(MAX_SWAP_ENTRIES / 8);
-	for(int i=0; i < MAX_SWAP_ENTRIES; i++) {
-		bitfield_set(swap_bitfield, i, 0);
+	// the clock sweeps over the core map
+	clock_size = frame_count();
+	clock_spread = min(CLOCK_HAND_SPREAD, clock_size / 2);
+	back_hand = 0;
+
+	// initialize the map for the swap file with its default size
+	swap_device = &SWAP_BACKEND;
+	swapmap_init(0, swap_device->init());
+
+	zswap_init();
+}
+
+
+/**
+ * Sorts the pages of a cluster by owner and virtual address.
+ * Clusters are small so insertion sort is good enough here.
+ *
+ * @param pages array of pages
+ * @param count number of elements in the array
+ */
+static void sort_cluster(core_map_entry** pages, int count) {
+
+	for(int i=1; i<count; i++) {
+		core_map_entry* current = pages[i];
+		int j = i-1;
+
+		while(j >= 0 && (pages[j]->tid.raw > current->tid.raw ||
+				(pages[j]->tid.raw == current->tid.raw && pages[j]->virtual_address > current->virtual_address))) {
+			pages[j+1] = pages[j];
+			j--;
+		}
+
+		pages[j+1] = current;
+	}
+
+}
+
+
+/**
+ * Gives every page in the cluster without a swap location a place
+ * in the swap file. We try to find one consecutive run for all of
+ * them first and fall back to single entries if the swap file is
+ * too fragmented.
+ *
+ * @param pages pages of the cluster (sorted)
+ * @param count number of pages
+ * @param without_slot number of pages which have no swap location yet
+ */
+static void assign_swap_slots(core_map_entry** pages, int count, int without_slot) {
+	int offset = allocate_swap_run(without_slot);
+
+	for(int i=0; i<count; i++) {
+		if(pages[i]->swap_offset >= 0)
+			continue;
+
+		if(offset >= 0) {
+			pages[i]->swap_offset = offset;
+			offset += PAGESIZE;
+		}
+		else {
+			pages[i]->swap_offset = allocate_swap_entry();
+		}
 	}
+
+}
+
+
+/**
+ * Hands a page to the swap backend, swap_write_done is called once
+ * it is written.
+ *
+ * @param page dirty page with a valid swap location
+ * @param cluster cluster the page belongs to
+ */
+static void write_page(core_map_entry* page, swap_cluster* cluster) {
+	// the user view has been flushed when the page was dereferenced,
+	// make sure we don't read old lines of our own view
+	frame_cache_flush(page_frame(page));
+
+	page->cluster = cluster;
+	// writes during the IO make the page dirty again
+	page->flags = (page->flags | FRAME_SWAPPING) & ~FRAME_DIRTY;
+	TAILQ_INSERT_TAIL(&swapping_pages_head, page, entries);
+	pages_in_flight++;
+
+	swap_device->write_page(page->swap_offset, page_frame(page), &swap_write_done, page);
 }
 
 
 /**
- * This function will select a page (based on second chance)
- * and swap it out to file system. However if the selected page
- * was not dirty then we just need to mark it swapped again and
- * can return immediatly.
- * We stop the initiator thread as long as we're swapping
- * data out to the file system. The thread is restarted in the
- * write callback function (above).
+ * This function will select up to SWAP_CLUSTER_SIZE pages (based on
+ * the clock) and swap them out to the file system. Pages which are
+ * not dirty just need to be marked as swapped again. Dirty pages are
+ * written out together as one cluster.
+ * If no frame could be freed right away we stop the initiator thread
+ * until the first page of the cluster is written out. The thread is
+ * restarted in the write callback function (above).
  *
  * @param initiator ID of the thread who caused the swapping to happen
- * @return	SWAPPING_PENDING in case we need to write the page to the disk
- * 			SWAPPING_COMPLETE in case the page was not dirty
+ * @param local only evict pages of the initiator (local replacement)
+ * @return	SWAPPING_PENDING in case we need to write the pages to the disk first
+ * 			SWAPPING_COMPLETE in case at least one frame is free again
  * 			OUT_OF_SWAP_SPACE if our swap space is already full
- * 			NO_PAGE_AVAILABLE if second_chance_select did not find a page
+ * 			NO_PAGE_AVAILABLE if clock_select did not find a page
  */
-int swap_out(L4_ThreadId_t initiator) {
-	page_queue_item* page = second_chance_select(&active_pages_head);
-	if(page == NULL) {
-		return NO_PAGE_AVAILABLE;
-	}
-	assert(!is_referenced(page));
-
-	// decide where in the swap file our page will be
-	if(page->swap_offset < 0 && (page->swap_offset = allocate_swap_entry()) < 0)
-		return OUT_OF_SWAP_SPACE;
-
-	dprintf(1, "swap_out: Second chance selected page: thread:0x%X vaddr:0x%X swap_offset:0x%X\n", page->tid, page->virtual_address, page->swap_offset);
-
-	if(is_dirty(page)) {
-		dprintf(1, "Selected page is dirty, need to write to swap space\n");
-
-		page->to_swap = PAGESIZE;
-		page->initiator = initiator;
-		TAILQ_INSERT_TAIL(&swapping_pages_head, page, entries);
-
-		file_table_entry* swap_fd = get_process(root_thread_g)->filetable[SWAP_FD];
-		assert(swap_fd != NULL);
-
-		data_ptr physical_page = pager_physical_lookup(page->tid, page->virtual_address);
-		assert(physical_page != NULL);
-
-		// write page in swap file
-		assert(PAGESIZE % BATCH_SIZE == 0);
-		for(int write_offset=0; write_offset < page->to_swap; write_offset += BATCH_SIZE) {
-			nfs_write(
-				&swap_fd->file->nfs_handle,
-				page->swap_offset + write_offset,
-				BATCH_SIZE,
-				physical_page + write_offset,
-				&swap_write_callback,
-				(int)page
-			);
+int swap_out(L4_ThreadId_t initiator, L4_Bool_t local) {
+	core_map_entry* selected[SWAP_CLUSTER_SIZE];
+	int dirty_pages = 0;
+	int freed_pages = 0;
+	int without_slot = 0;
+
+	while(dirty_pages + freed_pages < SWAP_CLUSTER_SIZE) {
+		core_map_entry* page = local ? local_select(initiator) : clock_select();
+		if(page == NULL)
+			break;
+		assert(!is_referenced(page));
+
+		dprintf(1, "swap_out: Clock selected page: thread:0x%X vaddr:0x%X swap_offset:0x%X\n", page->tid, page->virtual_address, page->swap_offset);
+
+		if(is_dirty(page)) {
+			// the other users of a shared slot still need the old contents
+			if(page->swap_offset >= 0 && shared_slot_lookup(page->swap_offset) != NULL) {
+				swap_free(page->swap_offset);
+				page->swap_offset = -1;
+			}
+
+			selected[dirty_pages++] = page;
+			if(page->swap_offset < 0)
+				without_slot++;
 		}
+		else {
+			// clean pages still have a valid copy in the swap file (or the executable)
+			evict_page(page);
+			freed_pages++;
+			vm_stats.swap_writes_avoided++;
+		}
+	}
+
+	if(dirty_pages == 0)
+		return (freed_pages > 0) ? SWAPPING_COMPLETE : NO_PAGE_AVAILABLE;
 
-		return SWAPPING_PENDING;
+	// neighbouring virtual pages should end up next to each other in the swap file
+	sort_cluster(selected, dirty_pages);
+	assign_swap_slots(selected, dirty_pages, without_slot);
+
+	// pages we could not find a swap location for stay active,
+	// pages which fit into the compressed pool are gone right away
+	int cluster_pages = 0;
+	for(int i=0; i<dirty_pages; i++) {
+		if(selected[i]->swap_offset < 0) {
+			track(selected[i]);
+		}
+		else if(zswap_store(selected[i]->swap_offset, page_frame(selected[i]))) {
+			evict_page(selected[i]);
+			freed_pages++;
+		}
+		else {
+			selected[cluster_pages++] = selected[i];
+		}
 	}
-	else {
-		assert(page->swap_offset >= 0);
-		page_table_entry* pte = pager_table_lookup(page->tid, page->virtual_address);
-		frame_free(CLEAR_LOWER_BITS(pte->address));
-		mark_swapped(pte, page->swap_offset);
-		free(page);
 
-		return SWAPPING_COMPLETE;
+	if(cluster_pages == 0)
+		return (freed_pages > 0) ? SWAPPING_COMPLETE : OUT_OF_SWAP_SPACE;
+
+	dprintf(1, "Writing cluster of %d dirty pages to swap space\n", cluster_pages);
+
+	swap_cluster* cluster = slab_alloc(&swap_cluster_cache);
+	assert(cluster != NULL);
+	cluster->pages_pending = cluster_pages;
+	// if a frame is already available the cluster is written behind the back of the initiator
+	cluster->initiator = (freed_pages > 0) ? L4_nilthread : initiator;
+
+	for(int i=0; i<cluster_pages; i++)
+		write_page(selected[i], cluster);
+
+	vm_stats.swap_clusters++;
+	vm_stats.swap_cluster_pages += cluster_pages;
+	vm_stats.swap_max_cluster = max(vm_stats.swap_max_cluster, cluster_pages);
+
+	return (freed_pages > 0) ? SWAPPING_COMPLETE : SWAPPING_PENDING;
+}
+
+
+/**
+ * Returns the number of pages which are currently written
+ * to the swap file. Their frames will be free soon.
+ *
+ * @return number of pages being swapped out
+ */
+int swap_out_pending(void) {
+	return pages_in_flight;
+}
+
+
+/**
+ * Returns the number of pages which are currently read from or
+ * written to the swap file.
+ *
+ * @return number of pages with IO in progress
+ */
+int swap_io_pending(void) {
+	core_map_entry* page;
+	int pending = 0;
+
+	TAILQ_FOREACH(page, &swapping_pages_head, entries)
+		pending++;
+
+	return pending;
+}
+
+
+/**
+ * Takes away the reference bits of all pages of a process in the
+ * clock, so they are evicted the next time the back hand passes
+ * (used for suspended processes, see loadctl.c).
+ *
+ * @param tid owner of the pages
+ */
+void swap_dereference_all(L4_ThreadId_t tid) {
+
+	for(L4_Word_t i=0; i<clock_size; i++) {
+		core_map_entry* page = &core_map[i];
+
+		if((page->flags & FRAME_TRACKED) && L4_IsThreadEqual(page->tid, tid))
+			dereference(page);
 	}
 
 }
@@ -449,18 +1215,44 @@ int swap_out(L4_ThreadId_t initiator) {
 /**
  * Called by the pager. Reads a given page back into memory.
  *
- * @param page the page we wan't to read back into memory
- * @return SWAPPING_PENDING
+ * @param tid owner of the page
+ * @param addr virtual address of the page
+ * @param frame newly allocated frame the page is read into
+ * @param swap_offset location of the page in the swap file
+ * @param prefetch TRUE if the page is read ahead (nobody waits for it,
+ * the page is not mapped once it is read)
+ * @return SWAPPING_COMPLETE if the page was in the compressed pool
+ * 			SWAPPING_PENDING if it is read from the swap file
  */
-int swap_in(page_queue_item* page) {
-	assert(page != NULL);
-	file_table_entry* swap_fd = get_process(root_thread_g)->filetable[SWAP_FD];
-	assert(swap_fd != NULL);
+int swap_in(L4_ThreadId_t tid, L4_Word_t addr, L4_Word_t frame, int swap_offset, L4_Bool_t prefetch) {
+	core_map_entry* page = frame_entry(frame);
+	assert(page->flags == 0);
+
+	page->tid = tid;
+	page->virtual_address = addr;
+	page->read_start = prefetch ? 0 : (L4_Word_t) get_time_stamp();
+
+	if(zswap_load(swap_offset, frame)) {
+		// the pool copy is dropped, so the page has to be written next time
+		frame_cache_flush(frame);
+		page->flags = (prefetch ? FRAME_PREFETCH : FRAME_REFERENCED) | FRAME_DIRTY;
+		page->swap_offset = -1;
+		track(page);
+		swap_free(swap_offset);
+
+		if(!prefetch) {
+			vm_stats.zswap_hits++;
+			vm_stats.zswap_hit_us += (L4_Word_t) get_time_stamp() - page->read_start;
+		}
+		return SWAPPING_COMPLETE;
+	}
 
-	page->to_swap = 0; // to keep track of how many bytes are read
+	page->swap_offset = swap_offset;
+	page->flags = FRAME_SWAPPING | (prefetch ? FRAME_PREFETCH : 0);
+	page->cluster = NULL;
 	TAILQ_INSERT_TAIL(&swapping_pages_head, page, entries);
 
-	nfs_read(&swap_fd->file->nfs_handle, page->swap_offset+page->to_swap, BATCH_SIZE, &swap_read_callback, (int)page);
+	swap_device->read_page(swap_offset, frame, &swap_read_done, page);
 
 	return SWAPPING_PENDING;
 }
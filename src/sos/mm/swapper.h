@@ -3,23 +3,16 @@
 
 #include <nfs.h>
 #include "pager.h"
+#include "frames.h"
 #include "../queue.h"
 
-/** Information tracked for all active pages */
-typedef struct pit {
-	TAILQ_ENTRY(pit) entries;
-	L4_Bool_t process_deleted;	/**< If we need to call back to the thread */
+/** A group of pages which is written to the swap file in one go */
+typedef struct swap_cluster {
+	int pages_pending;			/**< Number of pages in the cluster which are not yet completely written */
+	L4_ThreadId_t initiator;	/**< Restarted as soon as the first frame of the cluster is free again */
+} swap_cluster;
 
-	L4_ThreadId_t tid;			/**< Owner of the page */
-	L4_Word_t virtual_address;	/**< Virtual address which accesses the page */
-
-	int swap_offset;			/**< Where in the swap file this page is located, -1 if currently not in swap */
-	int to_swap;				/**< Used to keep track of how many bytes have been swapped out/in already */
-	L4_ThreadId_t initiator;	/**< Used by swap out (this thread is restarted after we finished swapping out) */
-} page_queue_item;
-
-TAILQ_HEAD(pages_head, pit);
-extern struct pages_head active_pages_head;
+TAILQ_HEAD(pages_head, cme);
 extern struct pages_head swapping_pages_head;
 
 
@@ -35,7 +28,18 @@ extern struct pages_head swapping_pages_head;
 void swap_free(int);
 L4_Bool_t swap_get(int);
 void swap_init(void);
-int swap_out(L4_ThreadId_t);
-int swap_in(page_queue_item*);
+int swap_out(L4_ThreadId_t, L4_Bool_t local);
+int swap_out_pending(void);
+int swap_io_pending(void);
+void swap_dereference_all(L4_ThreadId_t);
+int swap_in(L4_ThreadId_t, L4_Word_t addr, L4_Word_t frame, int swap_offset, L4_Bool_t prefetch);
+void swap_track(L4_ThreadId_t, L4_Word_t addr, L4_Word_t frame);
+void swap_track_text(L4_ThreadId_t, L4_Word_t addr, L4_Word_t frame);
+void swap_track_large(L4_ThreadId_t, L4_Word_t addr, L4_Word_t frame);
+void swap_release(L4_Word_t frame);
+void swap_cancel(L4_ThreadId_t);
+void swap_share(L4_Word_t frame);
+void swap_unshare(L4_Word_t frame);
+void swap_dup(int offset);
 
 #endif /* SWAPPER_H_ */
@@ -0,0 +1,382 @@
+/**
+ * Compressed Swap Pool
+ * =============
+ * Writing a page to the swap file over NFS takes orders of magnitude
+ * longer than compressing it. So dirty pages the clock selects are
+ * first compressed (see compress.c) into a pool of frames reserved
+ * at start-up. Such a page is evicted right away, just like a clean
+ * page. Its page table entry points to its swap slot as usual, the
+ * pool is looked up by the swap offset before a page is read from
+ * the swap file.
+ *
+ * Pool Layout
+ * ------------------------------
+ * Every pool frame is divided into ZSWAP_CHUNKS chunks. A compressed
+ * page takes the next free run of chunks within a single frame
+ * (kept in a bitmap per frame). Pages which don't compress to at most
+ * ZSWAP_MAX_CHUNKS chunks are written to the swap file directly.
+ *
+ * Writeback
+ * ------------------------------
+ * Once more than ZSWAP_HIGH_PERCENT of the chunks are used, the oldest
+ * pages in the pool are written to their swap slot. A page being
+ * written back is decompressed into one of ZSWAP_WRITEBACK_BUFFERS
+ * reserved frames, so its chunks are free again immediately. Until
+ * the write is done it can still be loaded from there.
+ * If the pool is full nonetheless, pages go to the swap file directly
+ * (the pool never makes the faulting thread wait).
+ *
+ * Loading and Freeing
+ * ------------------------------
+ * A page loaded from the pool keeps its entry, the swapper releases
+ * the swap slot afterwards (the page is dirty again). Freeing a slot
+ * drops the entry. If a writeback of the slot is still in flight,
+ * the slot itself is freed by the write callback, so a new page in
+ * the same slot can't be overwritten by the old data.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <sos_shared.h>
+
+#include "../l4.h"
+#include "../libsos.h"
+#include "zswap.h"
+#include "compress.h"
+#include "pager.h"
+#include "swapper.h"
+#include "swapmap.h"
+#include "swapdev.h"
+#include "frames.h"
+#include "slab.h"
+
+#define verbose 1
+
+/** Maximum number of frames reserved for the pool */
+#define ZSWAP_POOL_FRAMES 128
+/** Chunks per pool frame */
+#define ZSWAP_CHUNKS 8
+/** Size of a chunk */
+#define ZSWAP_CHUNK_SIZE (PAGESIZE / ZSWAP_CHUNKS)
+/** Pages which need more chunks go to the swap file directly */
+#define ZSWAP_MAX_CHUNKS 6
+/** Used chunks (in percent) above which the oldest pages are written back */
+#define ZSWAP_HIGH_PERCENT 75
+/** Number of pages which can be written back at the same time */
+#define ZSWAP_WRITEBACK_BUFFERS 2
+/** Number of hash buckets (indexed by swap slot) */
+#define ZSWAP_BUCKETS 256
+
+/** Entry is being written to the swap file */
+#define ZSWAP_WRITING	0x1
+/** Entry has been dropped while it was written, free the slot afterwards */
+#define ZSWAP_FORGOTTEN	0x2
+
+/** Compressed page in the pool */
+typedef struct zswap_entry {
+	int offset;								/**< Swap slot of the page */
+	int length;								/**< Size of the compressed data */
+	int frame;								/**< Index of the pool frame (-1 while writing) */
+	int chunk;								/**< First chunk in the pool frame */
+	int flags;								/**< ZSWAP_* bits */
+	int buffer;								/**< Writeback buffer holding the uncompressed page */
+	TAILQ_ENTRY(zswap_entry) age;			/**< Links entries from oldest to newest */
+	struct zswap_entry* next;				/**< Next entry in the same bucket */
+} zswap_entry;
+
+/** Object cache for the entries (see slab.c) */
+static slab_cache zswap_entry_cache = SLAB_CACHE_INITIALIZER("zswap entry", zswap_entry);
+
+TAILQ_HEAD(zswap_head, zswap_entry);
+static struct zswap_head zswap_age_head;
+
+static zswap_entry* zswap_buckets[ZSWAP_BUCKETS];
+
+static L4_Word_t pool_frames[ZSWAP_POOL_FRAMES];	/**< Frames of the pool */
+static uint8_t pool_used[ZSWAP_POOL_FRAMES];		/**< Bit set for every used chunk */
+static int pool_size;								/**< Number of frames in the pool */
+static int pool_next;								/**< Frame the next allocation starts looking */
+
+static L4_Word_t buffers[ZSWAP_WRITEBACK_BUFFERS];	/**< Frames for pages being written back */
+static L4_Bool_t buffer_used[ZSWAP_WRITEBACK_BUFFERS];
+
+/** Compression output (may be larger than what is stored) */
+static uint8_t compressed[ZSWAP_MAX_CHUNKS * ZSWAP_CHUNK_SIZE];
+
+
+/**
+ * Finds the pool entry of a swap slot.
+ *
+ * @param offset swap offset
+ * @return entry or NULL if the slot is not in the pool
+ */
+static zswap_entry* zswap_lookup(int offset) {
+	zswap_entry* entry = zswap_buckets[(offset / PAGESIZE) % ZSWAP_BUCKETS];
+
+	while(entry != NULL && entry->offset != offset)
+		entry = entry->next;
+
+	return entry;
+}
+
+
+/**
+ * Removes an entry from the hash table and the age list and frees it.
+ * @param entry entry which is not using any chunks
+ */
+static void zswap_remove(zswap_entry* entry) {
+	zswap_entry** link = &zswap_buckets[(entry->offset / PAGESIZE) % ZSWAP_BUCKETS];
+
+	while(*link != entry)
+		link = &(*link)->next;
+	*link = entry->next;
+
+	TAILQ_REMOVE(&zswap_age_head, entry, age);
+	slab_free(entry);
+}
+
+
+/**
+ * Returns the bitmap of `chunks` chunks starting at `chunk`.
+ */
+static inline uint8_t chunk_mask(int chunk, int chunks) {
+	return ((1 << chunks) - 1) << chunk;
+}
+
+
+/**
+ * Finds and reserves a run of free chunks in one of the pool frames.
+ *
+ * @param chunks number of chunks needed
+ * @param frame set to the index of the pool frame
+ * @param chunk set to the first chunk of the run
+ * @return TRUE if a run was found
+ */
+static L4_Bool_t chunks_alloc(int chunks, int* frame, int* chunk) {
+
+	for(int i=0; i<pool_size; i++) {
+		int f = (pool_next + i) % pool_size;
+
+		for(int c=0; c + chunks <= ZSWAP_CHUNKS; c++) {
+			if((pool_used[f] & chunk_mask(c, chunks)) == 0) {
+				pool_used[f] |= chunk_mask(c, chunks);
+				vm_stats.zswap_chunks_used += chunks;
+
+				*frame = f;
+				*chunk = c;
+				pool_next = f;
+				return TRUE;
+			}
+		}
+	}
+
+	return FALSE;
+}
+
+
+/**
+ * Gives the chunks of an entry back to the pool.
+ * @param entry entry using chunks in a pool frame
+ */
+static void chunks_free(zswap_entry* entry) {
+	int chunks = (entry->length + ZSWAP_CHUNK_SIZE - 1) / ZSWAP_CHUNK_SIZE;
+
+	assert(entry->frame >= 0);
+	pool_used[entry->frame] &= ~chunk_mask(entry->chunk, chunks);
+	vm_stats.zswap_chunks_used -= chunks;
+	entry->frame = -1;
+}
+
+
+/**
+ * Returns the address of the compressed data of an entry.
+ */
+static uint8_t* entry_data(zswap_entry* entry) {
+	return (uint8_t*) (pool_frames[entry->frame] + entry->chunk * ZSWAP_CHUNK_SIZE);
+}
+
+
+/**
+ * Called by the swap backend once a page is written back. The entry
+ * is dropped, the page is read from the swap file from now on.
+ *
+ * @param token entry
+ * @param status SWAP_IO_OK or an error of the backend
+ */
+static void zswap_write_done(void* token, int status) {
+	zswap_entry* entry = (zswap_entry*) token;
+
+	if(status != SWAP_IO_OK) {
+		dprintf(0, "%s: Swap backend %s failed (%d).\n", __FUNCTION__, swap_device->name, status);
+		assert(FALSE);
+	}
+
+	buffer_used[entry->buffer] = FALSE;
+
+	if(entry->flags & ZSWAP_FORGOTTEN) {
+		swap_device->trim(entry->offset);
+		swapmap_free(entry->offset / PAGESIZE);
+	}
+
+	zswap_remove(entry);
+	vm_stats.zswap_writebacks++;
+}
+
+
+/**
+ * Starts to write the oldest pages of the pool to the swap file
+ * while the pool is above its high mark and writeback buffers are
+ * available.
+ */
+static void zswap_writeback(void) {
+	zswap_entry* entry = TAILQ_FIRST(&zswap_age_head);
+
+	while(entry != NULL && vm_stats.zswap_chunks_used * 100 > vm_stats.zswap_chunks * ZSWAP_HIGH_PERCENT) {
+
+		if(entry->flags & ZSWAP_WRITING) {
+			entry = TAILQ_NEXT(entry, age);
+			continue;
+		}
+
+		int b;
+		for(b=0; b<ZSWAP_WRITEBACK_BUFFERS && buffer_used[b]; b++)
+			;
+		if(b == ZSWAP_WRITEBACK_BUFFERS)
+			break;
+
+		int length = decompress_block(entry_data(entry), entry->length, (uint8_t*) buffers[b], PAGESIZE);
+		assert(length == PAGESIZE);
+
+		buffer_used[b] = TRUE;
+		entry->buffer = b;
+		entry->flags |= ZSWAP_WRITING;
+		chunks_free(entry);
+
+		swap_device->write_page(entry->offset, buffers[b], &zswap_write_done, entry);
+
+		entry = TAILQ_NEXT(entry, age);
+	}
+
+}
+
+
+/**
+ * Reserves the frames of the pool. Smaller memory configurations get
+ * a smaller pool (an eighth of the free frames at most).
+ */
+void zswap_init(void) {
+	TAILQ_INIT(&zswap_age_head);
+
+	pool_size = min(ZSWAP_POOL_FRAMES, frame_count_free() / 8);
+
+	for(int i=0; i<pool_size; i++) {
+		pool_frames[i] = frame_alloc();
+		assert(pool_frames[i] != 0);
+		frame_entry(pool_frames[i])->flags = FRAME_PINNED;
+	}
+
+	for(int i=0; i<ZSWAP_WRITEBACK_BUFFERS; i++) {
+		buffers[i] = frame_alloc();
+		assert(buffers[i] != 0);
+		frame_entry(buffers[i])->flags = FRAME_PINNED;
+	}
+
+	vm_stats.zswap_chunks = pool_size * ZSWAP_CHUNKS;
+}
+
+
+/**
+ * Compresses a page into the pool. The frame of the page can be
+ * freed afterwards.
+ *
+ * @param offset swap slot assigned to the page
+ * @param frame frame holding the page
+ * @return TRUE if the page is stored in the pool, FALSE if it needs
+ * to be written to the swap file
+ */
+L4_Bool_t zswap_store(int offset, L4_Word_t frame) {
+	assert(zswap_lookup(offset) == NULL);
+
+	if(pool_size == 0)
+		return FALSE;
+
+	// don't compress old lines of our own view (see write_page)
+	frame_cache_flush(frame);
+	int length = compress_block((uint8_t*) frame, PAGESIZE, compressed, sizeof(compressed));
+	int frame_index, chunk;
+
+	if(length == 0 || !chunks_alloc((length + ZSWAP_CHUNK_SIZE - 1) / ZSWAP_CHUNK_SIZE, &frame_index, &chunk)) {
+		vm_stats.zswap_rejects++;
+		zswap_writeback();
+		return FALSE;
+	}
+
+	zswap_entry* entry = slab_alloc(&zswap_entry_cache);
+	assert(entry != NULL);
+	entry->offset = offset;
+	entry->length = length;
+	entry->frame = frame_index;
+	entry->chunk = chunk;
+	entry->flags = 0;
+
+	memcpy(entry_data(entry), compressed, length);
+
+	entry->next = zswap_buckets[(offset / PAGESIZE) % ZSWAP_BUCKETS];
+	zswap_buckets[(offset / PAGESIZE) % ZSWAP_BUCKETS] = entry;
+	TAILQ_INSERT_TAIL(&zswap_age_head, entry, age);
+
+	vm_stats.zswap_stores++;
+	vm_stats.zswap_stored_bytes += length;
+
+	zswap_writeback();
+	return TRUE;
+}
+
+
+/**
+ * Copies a page from the pool into a frame.
+ *
+ * @param offset swap slot of the page
+ * @param frame frame to fill
+ * @return TRUE if the page was in the pool
+ */
+L4_Bool_t zswap_load(int offset, L4_Word_t frame) {
+	zswap_entry* entry = zswap_lookup(offset);
+
+	if(entry == NULL || (entry->flags & ZSWAP_FORGOTTEN))
+		return FALSE;
+
+	if(entry->flags & ZSWAP_WRITING) {
+		memcpy((void*) frame, (void*) buffers[entry->buffer], PAGESIZE);
+	}
+	else {
+		int length = decompress_block(entry_data(entry), entry->length, (uint8_t*) frame, PAGESIZE);
+		assert(length == PAGESIZE);
+	}
+
+	return TRUE;
+}
+
+
+/**
+ * Drops the page of a swap slot which is freed from the pool.
+ *
+ * @param offset swap slot
+ * @return TRUE if the slot is written back right now and is freed
+ * once the write is done (the caller must not free it)
+ */
+L4_Bool_t zswap_forget(int offset) {
+	zswap_entry* entry = zswap_lookup(offset);
+
+	if(entry == NULL)
+		return FALSE;
+
+	if(entry->flags & ZSWAP_WRITING) {
+		entry->flags |= ZSWAP_FORGOTTEN;
+		return TRUE;
+	}
+
+	chunks_free(entry);
+	zswap_remove(entry);
+	return FALSE;
+}
@@ -0,0 +1,11 @@
+#ifndef ZSWAP_H_
+#define ZSWAP_H_
+
+#include <l4/types.h>
+
+void zswap_init(void);
+L4_Bool_t zswap_store(int offset, L4_Word_t frame);
+L4_Bool_t zswap_load(int offset, L4_Word_t frame);
+L4_Bool_t zswap_forget(int offset);
+
+#endif /* ZSWAP_H_ */
@@ -20,6 +20,7 @@
 #include <l4/cache.h>
 #include "process.h"
 #include "libsos.h"
+#include "mm/loadctl.h"
 
 #define verbose 1
 
@@ -29,32 +30,6 @@ static L4_Word_t next_task;
 static process ptable[MAX_RUNNING_PROCESS];
 
 
-/**
- * Finds a executable placed within in the bootimage file.
- * @param name executable name
- * @return boot record pointer for the executable or NULL if not found
- */
-static L4_BootRec_t* find_boot_executable(const char* name) {
-
-	// Loop through the BootInfo starting executables
-    int i;
-    L4_BootRec_t* binfo_rec;
-    for (i = 1; (binfo_rec = sos_get_binfo_rec(i)); i++) {
-
-    	if (L4_BootRec_Type(binfo_rec) != L4_BootInfo_SimpleExec)
-			continue;
-
-    	if(strcmp(L4_SimpleExec_Cmdline(binfo_rec), name) == 0) {
-			dprintf(1, "Found executable for process create: %d %s\n", i, L4_SimpleExec_Cmdline(binfo_rec));
-    		return binfo_rec;
-    	}
-
-    }
-
-    return NULL;
-}
-
-
 /**
  * Converts a given thread id to the corresponding pid.
  * @param tid Thread ID
@@ -142,7 +117,6 @@ void process_init() {
 	// initialize process table
 	for(int i=0; i<MAX_RUNNING_PROCESS; i++) {
 		ptable[i].is_active = FALSE;
-		ptable[i].initialized = FALSE;
 		ptable[i].page_index = NULL;
 		ptable[i].size = 0;
 		ptable[i].start_time = 0ULL;
@@ -155,7 +129,7 @@ void process_init() {
 	// add root process as first process in table
 	register_process("[sos]");
 	ptable[0].tid = root_thread_g;
-	free(ptable[0].page_index);
+	pager_free_page_index(ptable[0].page_index);
 	ptable[0].page_index = NULL;
 }
 
@@ -203,7 +177,19 @@ process* register_process(char* name) {
 	new_process->start_time = get_time_stamp();
 	new_process->tid.global.X.version = 1; // TODO why is this not working with increasing version number?
 	new_process->is_active = TRUE;
-	new_process->initialized = FALSE;
+	new_process->image.file = NULL;
+	new_process->image.segment_count = 0;
+	new_process->heap_break = HEAP_START;
+	new_process->heap_limit = HEAP_DEFAULT_LIMIT;
+	new_process->stack_bottom = STACK_TOP - STACK_INITIAL_SIZE;
+	new_process->resident = 0;
+	new_process->referenced = 0;
+	new_process->working_set = 0;
+	new_process->frame_quota = 0;
+	new_process->suspended_since = 0;
+	new_process->last_swap_fault = 0;
+	new_process->last_swap_offset = -1;
+	new_process->readahead_window = 0;
 
 	// set up file table with default NULL values
 	for(int i=0; i<PROCESS_MAX_FILES; i++) {
@@ -212,34 +198,85 @@ process* register_process(char* name) {
 
 	// initialize standard out file descriptor
 	file_table_entry** file_table = new_process->filetable;
-	file_table[0] = malloc(sizeof(file_table_entry));
-	assert(file_table[0] != NULL);
-	file_table[0]->file = file_cache[0];
-	file_table[0]->mode = FM_WRITE;
-	file_table[0]->owner = new_process->tid;
-	file_table[0]->to_read = 0;
-	file_table[0]->client_buffer = NULL;
+	file_table[0] = create_file_descriptor(file_cache[0], new_process->tid, FM_WRITE);
 
 	// initialize page index (first level page table)
-	new_process->page_index = malloc(sizeof(page_table_entry)*FIRST_LEVEL_ENTRIES);
-	assert(new_process->page_index != NULL);
-	for(int i=0; i<FIRST_LEVEL_ENTRIES; i++)
-		new_process->page_index[i].address_ptr = NULL;
+	new_process->page_index = pager_alloc_page_index();
+	memset(new_process->page_tables, 0, sizeof(new_process->page_tables));
 
 	return new_process;
 }
 
 
+/** Process creation waiting for the header of its executable */
+typedef struct create_request {
+	L4_ThreadId_t creator;		/**< Thread which called process_create (nilthread for sos itself) */
+	char name[N_NAME+1];		/**< Name of the executable */
+} create_request;
+
+
+/**
+ * Called by the loader once the header of an executable has been
+ * read. Sets up the entry in the process table, tells L4 to start
+ * the process at the entry point of the binary and replies to the
+ * creator.
+ *
+ * @param token create_request
+ * @param status 0 if the executable can be loaded, error code for
+ * process_create otherwise
+ * @param image segments of the executable
+ */
+static void executable_loaded(uintptr_t token, int status, elf_image* image) {
+	create_request* request = (create_request*) token;
+	int ret = status;
+
+	if(status == 0) {
+		process* pentry = register_process(request->name);
+
+		if(pentry == NULL) {
+			ret = PROCESS_TABLE_FULL;
+		}
+		else {
+			pentry->image = *image;
+
+			L4_ThreadId_t newtid = sos_task_new(
+					pentry->tid,
+					root_thread_g,
+					(void *) image->entry,
+					(void *) STACK_TOP,
+					L4_Version(pentry->tid) == 1
+			);
+
+			dprintf(1, "Created task: ox%X (pentry->tid:ox%X) pid:%d\n", newtid, pentry->tid, tid2pid(newtid));
+			ret = tid2pid(newtid);
+		}
+	}
+	else {
+		dprintf(0, "create_process failed: %s is not a valid executable (%d).\n", request->name, status);
+	}
+
+	// the creator might have been deleted in the mean time
+	process* creator = get_process(request->creator);
+	if(!L4_IsNilThread(request->creator) && creator->is_active && L4_IsThreadEqual(creator->tid, request->creator))
+		send_ipc_reply(request->creator, SOS_PROCESS_CREATE, 1, ret);
+
+	free(request);
+}
+
+
 /**
  * Syscall handler for creating a process. This will perform the following steps:
- * 1. Find the executable in the boot image
- * 2. Setup a entry in the process table
- * 3. Tell L4 to start the process
+ * 1. Find the executable in the file cache
+ * 2. Read its ELF header (see loader.c)
+ * 3. Setup a entry in the process table
+ * 4. Tell L4 to start the process
+ * Steps 3 and 4 are done in the callback of the loader, the text and
+ * data pages are read from the file on demand afterwards.
  *
  * @param tid Callee Thread ID
  * @param msg_p IPC message
  * @param buf Shared IPC memory (containing name of the executable)
- * @return 1 (send a reply to the callee)
+ * @return 0 (reply is sent once the header is read) or 1 in case of an error
  */
 int create_process(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
 	if(buf == NULL)
@@ -258,84 +295,52 @@ int create_process(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
 		dprintf(0, "create_process failed: The file you're trying to execute has no executable rights.\n");
 		return IPC_SET_ERROR(FILE_NOT_EXECUTABLE);
 	}
-	else if( file_cache[file_cache_index]->status.st_size > ONE_MEGABYTE*4 )  {
-		dprintf(0, "create_process failed: The elf binary should not be larger than the heap size.\n");
-		return IPC_SET_ERROR(FILE_TOO_BIG);
-	}
 
-	L4_BootRec_t* boot_record = find_boot_executable("initializer");
+	create_request* request = malloc(sizeof(create_request));
+	assert(request != NULL);
+	request->creator = tid;
+	strcpy(request->name, name);
 
-	if(boot_record != NULL && file_cache_index != -1) {
-		// Start a new task with this program
-		process* pentry = register_process(name);
-		if(pentry == NULL)
-			return IPC_SET_ERROR(PROCESS_TABLE_FULL);
-
-		L4_ThreadId_t newtid = sos_task_new(
-				pentry->tid,
-				root_thread_g,
-				(void *) L4_SimpleExec_TextVstart(boot_record),
-				(void *) STACK_TOP,
-				L4_Version(pentry->tid) == 1
-		);
-
-		dprintf(1, "Created task: ox%X (pentry->tid:ox%X) pid:%d\n", newtid, pentry->tid, tid2pid(newtid));
-		return set_ipc_reply(msg_p, 1, tid2pid(newtid));
-	}
-
-	assert("Initializer not found in bootimg.bin. Check SConstruct!");
-	return IPC_SET_ERROR(-1);
+	loader_read_header(file_cache[file_cache_index], &executable_loaded, (uintptr_t)request);
+	return 0;
 }
 
 
 /**
- * Syscall handler used by the initializer binary to tell sos that
- * the elf binary is correctly loaded. This syscall will make sure
- * that everything in physical and the heap of the prozess
- * address space is freed again in the pager. And will reset
- * the instruction pointer of the process to the given elf
- * start address.
- * In case the loaded file is not a valid ELF binary the process is
- * just deleted.
+ * Syscall handler for process_clone. Creates a new process with a
+ * copy on write copy of the address space of the callee (see
+ * pager_clone) which starts at the given instruction and stack
+ * pointer. The clone gets its own file table (with just the console
+ * descriptor) since open files have a single owner.
  *
- * @param tid Thread ID of initializer process
- * @param msg_p IPC mesage
- * @param buf Shared IPC memory
- * @return 0 (no message sent)
+ * @param tid Callee Thread ID
+ * @param msg_p IPC message (instruction and stack pointer for the clone)
+ * @param buf Shared IPC memory (not used)
+ * @return 1 (send the pid of the clone to the callee)
  */
-int start_process(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
-	process* p = get_process(tid);
-
-	if(L4_UntypedWords(msg_p->tag) != 1 || p == NULL || p->initialized)
+int clone_process(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
+	if(L4_UntypedWords(msg_p->tag) != 2)
 		return IPC_SET_ERROR(-1);
 
-	int status = L4_MsgWord(msg_p, 0);
+	L4_Word_t ip = L4_MsgWord(msg_p, 0);
+	L4_Word_t sp = L4_MsgWord(msg_p, 1);
+	process* parent = get_process(tid);
 
-	if (status) {
-		L4_AbortIpc_and_stop_Thread(tid);
+	process* pentry = register_process(parent->command);
+	if(pentry == NULL)
+		return IPC_SET_ERROR(PROCESS_TABLE_FULL);
 
-		// unmap and free heap memory region
-		L4_Msg_t msg;
-		pager_unmap_initializer(tid);
-		pager_unmap_all(tid, &msg, NULL);
-		pager_unmap_range(tid,HEAP_START,HEAP_END);
-		pager_free_range(tid,HEAP_START,HEAP_END);
+	pentry->image = parent->image;
+	pentry->heap_break = parent->heap_break;
+	pentry->heap_limit = parent->heap_limit;
+	pentry->stack_bottom = parent->stack_bottom;
+	pentry->frame_quota = parent->frame_quota;
+	pager_clone(tid, pentry->tid);
 
-		p->initialized = TRUE;
+	L4_ThreadId_t newtid = sos_task_new(pentry->tid, root_thread_g, (void *) ip, (void *) sp, L4_Version(pentry->tid) == 1);
 
-		//L4_CacheFlushAll();
-		L4_Start_SpIp(tid, STACK_TOP, TEXT_START);
-	}
-	else {
-		// could not load elf file, delete process (with staged IPC message contents)
-		L4_Msg_t msg;
-		L4_MsgClear(&msg);
-		L4_MsgAppendWord(&msg, tid2pid(tid));
-		delete_process(tid, &msg, NULL);
-		dprintf(0, "Process has been deleted again, because of invalid ELF file.\n");
-	}
-
-	return 0;
+	dprintf(1, "Cloned task 0x%X: 0x%X pid:%d (%d pages)\n", tid, newtid, tid2pid(newtid), pentry->size);
+	return set_ipc_reply(msg_p, 1, tid2pid(newtid));
 }
 
 
@@ -371,7 +376,7 @@ int delete_process(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
 
 	pager_unmap_all(to_delete->tid, NULL, NULL);
 	pager_free_all(to_delete->tid); // free frames and pager memory
-	free(ptable[pid].page_index);	// free 1st level page index
+	pager_free_page_index(ptable[pid].page_index);	// free 1st level page index
 	ptable[pid].page_index = NULL;
 
 	// close all files & free handlers
@@ -387,7 +392,7 @@ int delete_process(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
 				if(L4_IsThreadEqual(to_delete->filetable[i]->file->reader, to_delete->tid))
 					to_delete->filetable[i]->file->reader = L4_nilthread;
 
-				free(to_delete->filetable[i]);
+				free_file_descriptor(to_delete->filetable[i]);
 				to_delete->filetable[i] = NULL;
 			}
 
@@ -407,6 +412,7 @@ int delete_process(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
 
 	// remove pending sleep timers for this process
 	remove_timers(to_delete->tid);
+	loadctl_forget(to_delete->tid);
 
 	// stop (delete?) thread
 	L4_AbortIpc_and_stop(to_delete->tid);
@@ -487,6 +493,9 @@ int get_process_status(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
 			strcpy(process_desc_ptr->command, p->command);
 			process_desc_ptr->pid = tid2pid(p->tid);
 			process_desc_ptr->size = p->size;
+			process_desc_ptr->resident = p->resident;
+			process_desc_ptr->working_set = p->working_set;
+			process_desc_ptr->quota = p->frame_quota;
 			process_desc_ptr->stime = (unsigned) ((get_time_stamp() - p->start_time) / 1000);
 			process_desc_ptr->ctime = 0;
 
@@ -499,25 +508,3 @@ int get_process_status(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
 
 	return set_ipc_reply(msg_p, 1, added);
 }
-
-
-/**
- * Syscall handler returns the name of the executable of a given process
- * this call only works during initialization phase and should not be used
- * by clients.
- *
- * @param tid Calle Thread ID
- * @param msg_p IPC Message
- * @param buf Shared IPC memory
- * @return send empty message back
- */
-int get_executable_name(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf) {
-	process* p = get_process(tid);
-
-	if(p == NULL || buf == NULL || p->initialized)
-		return IPC_SET_ERROR(-1);
-
-	strcpy(buf, p->command);
-	return set_ipc_reply(msg_p, 1, 0);
-}
-
@@ -8,10 +8,10 @@
 
 #include "io/io.h"
 #include "mm/pager.h"
+#include "mm/loader.h"
 
 /** Process Descriptor entries */
 typedef struct proc {
-	L4_Bool_t initialized;		/**< Set when ELF binary has been loaded and process code is being executed */
 	L4_Bool_t is_active;		/**< Determine if the process is active */
 
 	char command[N_NAME];		/**< Name of the executable */
@@ -20,21 +20,33 @@ typedef struct proc {
 	L4_ThreadId_t wait_for;		/**< Used by process_wait calls */
 
 	L4_Word_t  size;			/**< Used pages */
+	L4_Word_t  heap_break;		/**< End of the heap (moved by sbrk) */
+	L4_Word_t  heap_limit;		/**< Maximum size of the heap in bytes */
+	L4_Word_t  stack_bottom;	/**< Lowest address of the stack so far */
+	L4_Word_t  resident;		/**< Pages in the clock owned by the process */
+	L4_Word_t  referenced;		/**< Referenced pages the front hand passed in this revolution */
+	L4_Word_t  working_set;		/**< Referenced pages in the last revolution of the clock */
+	L4_Word_t  frame_quota;		/**< Maximum resident pages before local replacement (0 = none) */
+	timestamp_t suspended_since;	/**< Time the process was suspended by load control (0 = running) */
+	L4_Word_t  last_swap_fault;	/**< Virtual address of the last page read from swap */
+	int        last_swap_offset;	/**< Swap slot of the last page read from swap */
+	L4_Word_t  readahead_window;	/**< Pages read ahead after a sequential swap fault */
 	timestamp_t  start_time;	/**< Start time of the process */
 
 	file_table_entry* filetable[PROCESS_MAX_FILES];		/**< Filetable */
-	page_table_entry* page_index;						/**< 1st level page table */
+	page_table_entry* page_index;						/**< 1st level page table (PAGE_INDEX_ENTRIES entries, see pager.c) */
+	L4_Word_t page_tables[PAGE_TABLE_BITMAP_WORDS];	/**< Bit set for every page index entry with a 2nd level table */
+	elf_image image;									/**< Executable the text and data pages are loaded from */
 } process;
 
 #define MAX_RUNNING_PROCESS 128
 
 int create_process(L4_ThreadId_t, L4_Msg_t*, data_ptr);
-int start_process(L4_ThreadId_t, L4_Msg_t*, data_ptr);
+int clone_process(L4_ThreadId_t, L4_Msg_t*, data_ptr);
 int delete_process(L4_ThreadId_t, L4_Msg_t*, data_ptr);
 int wait_process(L4_ThreadId_t, L4_Msg_t*, data_ptr);
 int get_pid(L4_ThreadId_t, L4_Msg_t*, data_ptr);
 int get_process_status(L4_ThreadId_t, L4_Msg_t*, data_ptr);
-int get_executable_name(L4_ThreadId_t tid, L4_Msg_t* msg_p, data_ptr buf);
 
 void process_init(void);
 process* get_process(L4_ThreadId_t tid);
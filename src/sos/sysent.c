@@ -37,7 +37,7 @@
 #include "process.h"
 
 syscall_function_ptr sysent[SYSENT_SIZE] =  {
-		[0 ... 15] = NULL
+		[0 ... SYSENT_SIZE-1] = NULL
 };
 
 static void register_syscall(int ident, syscall_function_ptr func) {
@@ -58,12 +58,16 @@ void init_systable() {
 	register_syscall(SOS_TIMESTAMP, &send_timestamp);
 
 	register_syscall(SOS_PROCESS_CREATE, &create_process);
-	register_syscall(SOS_PROCESS_START, &start_process);
+	register_syscall(SOS_PROCESS_CLONE, &clone_process);
 	register_syscall(SOS_PROCESS_DELETE, &delete_process);
 	register_syscall(SOS_PROCESS_ID, &get_pid);
 	register_syscall(SOS_PROCESS_WAIT, &wait_process);
 	register_syscall(SOS_PROCESS_STATUS, &get_process_status);
-	register_syscall(SOS_PROCESS_GET_NAME, &get_executable_name);
 
 	register_syscall(SOS_UNMAP_ALL, &pager_unmap_all);
+	register_syscall(SOS_VM_STATS, &pager_stats);
+	register_syscall(SOS_VM_WATERMARKS, &pager_set_watermarks);
+	register_syscall(SOS_SBRK, &pager_sbrk);
+	register_syscall(SOS_HEAP_LIMIT, &pager_set_heap_limit);
+	register_syscall(SOS_FRAME_QUOTA, &pager_set_frame_quota);
 }
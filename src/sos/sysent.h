@@ -6,7 +6,7 @@
 
 typedef int(*syscall_function_ptr)(L4_ThreadId_t, L4_Msg_t*, data_ptr);
 
-#define SYSENT_SIZE 16
+#define SYSENT_SIZE 32
 syscall_function_ptr sysent[SYSENT_SIZE];
 
 void init_systable(void);
@@ -107,10 +107,11 @@ static int ps(int argc, char **argv) {
 
 	processes = process_status(process, MAX_PROCESSES);
 
-	printf("TID SIZE   STIME   CTIME COMMAND\n");
+	printf("TID SIZE  RES   WS QUOTA   STIME   CTIME COMMAND\n");
 
 	for (i = 0; i < processes; i++) {
-		printf("%3x %4x %7d %7d %s\n", process[i].pid, process[i].size,
+		printf("%3x %4x %4u %4u %5u %7d %7d %s\n", process[i].pid, process[i].size,
+				process[i].resident, process[i].working_set, process[i].quota,
 				process[i].stime, process[i].ctime, process[i].command);
 	}
 
@@ -286,6 +287,138 @@ static int kill_process(int argc, char **argv) {
 
 
 
+static int vmstat(int argc, char **argv) {
+	vm_stats_t stats;
+
+	if (argc != 1) {
+		printf("usage: %s\n", argv[0]);
+		return 1;
+	}
+
+	if (vm_stats(&stats) != 0) {
+		printf("%s: could not get statistics\n", argv[0]);
+		return 1;
+	}
+
+	printf("swap clusters:        %u\n", stats.swap_clusters);
+	printf("pages in clusters:    %u\n", stats.swap_cluster_pages);
+	printf("largest cluster:      %u\n", stats.swap_max_cluster);
+	if (stats.swap_clusters > 0)
+		printf("avg cluster size:     %u.%02u\n", stats.swap_cluster_pages / stats.swap_clusters,
+				(stats.swap_cluster_pages * 100 / stats.swap_clusters) % 100);
+	printf("swap write rpcs:      %u\n", stats.swap_write_rpcs);
+	printf("swap writes avoided:  %u (clean evictions)\n", stats.swap_writes_avoided);
+	if (stats.swap_write_rpcs > 0)
+		printf("pages per rpc:        %u.%03u\n", stats.swap_cluster_pages / stats.swap_write_rpcs,
+				(stats.swap_cluster_pages * 1000 / stats.swap_write_rpcs) % 1000);
+
+	printf("free frames:          %u\n", stats.free_frames);
+	printf("fragmentation:        %u%% (largest free run %u frames)\n", stats.frame_fragmentation, 1 << stats.largest_free_order);
+	printf("watermarks:           %u/%u\n", stats.low_watermark, stats.high_watermark);
+	printf("reclaim runs:         %u\n", stats.reclaim_runs);
+	printf("reclaimed pages:      %u\n", stats.reclaim_pages);
+	printf("direct reclaims:      %u\n", stats.direct_reclaims);
+
+	printf("clock evictions:      %u\n", stats.clock_evictions);
+	if (stats.clock_evictions > 0)
+		printf("avg scan length:      %u\n", stats.clock_scanned / stats.clock_evictions);
+	printf("max scan length:      %u\n", stats.clock_max_scan);
+
+	printf("zero pool hits:       %u\n", stats.zero_pool_hits);
+	printf("zero pool misses:     %u\n", stats.zero_pool_misses);
+
+	printf("swap slots:           %u/%u\n", stats.swap_slots_used, stats.swap_slots_total);
+
+	printf("page faults:          %u\n", stats.page_faults);
+	printf("large pages mapped:   %u\n", stats.large_page_maps);
+	printf("large page fallbacks: %u\n", stats.large_page_fallbacks);
+	printf("large pages broken:   %u\n", stats.large_page_breaks);
+	printf("exec pages loaded:    %u (%u reads)\n", stats.exec_page_ins, stats.exec_read_rpcs);
+	printf("text cache hits:      %u\n", stats.text_cache_hits);
+	printf("shared frames:        %u\n", stats.shared_frames);
+	printf("shared swap slots:    %u\n", stats.shared_swap_slots);
+	printf("clones:               %u (%u cow copies)\n", stats.clones, stats.cow_copies);
+	printf("fault-around pages:   %u\n", stats.fault_around_pages);
+	printf("zero page maps:       %u\n", stats.zero_page_maps);
+	printf("stack growths:        %u\n", stats.stack_growths);
+	printf("local reclaims:       %u\n", stats.local_reclaims);
+	printf("load control:         %u suspended, %u resumed\n", stats.loadctl_suspends, stats.loadctl_resumes);
+	printf("compressed pool:      %u/%u chunks used, %u stored, %u rejected, %u written back\n",
+			stats.zswap_chunks_used, stats.zswap_chunks, stats.zswap_stores, stats.zswap_rejects, stats.zswap_writebacks);
+	if(stats.zswap_stored_bytes > 0)
+		printf("compression ratio:    %u.%02u\n", stats.zswap_stores * 4096 / stats.zswap_stored_bytes,
+				(stats.zswap_stores * 4096 % stats.zswap_stored_bytes) * 100 / stats.zswap_stored_bytes);
+	if(stats.zswap_hits + stats.zswap_misses > 0)
+		printf("pool hit rate:        %u%% (%u hits, %u swap file reads)\n",
+				stats.zswap_hits * 100 / (stats.zswap_hits + stats.zswap_misses), stats.zswap_hits, stats.zswap_misses);
+	printf("swap in latency:      pool %u us, swap file %u us\n",
+			stats.zswap_hits ? stats.zswap_hit_us / stats.zswap_hits : 0,
+			stats.zswap_misses ? stats.zswap_miss_us / stats.zswap_misses : 0);
+	printf("same-page merging:    %u hashed, %u zero, %u merged (%u frames reclaimed)\n",
+			stats.merge_scanned, stats.merge_zero_pages, stats.merge_pages, stats.merge_zero_pages + stats.merge_pages);
+	printf("readahead:            %u pages, %u hits, %u wasted\n", stats.readahead_pages, stats.readahead_hits, stats.readahead_wasted);
+	if(stats.readahead_pages > 0)
+		printf("readahead accuracy:   %u%%\n", stats.readahead_hits * 100 / stats.readahead_pages);
+
+	printf("server heap:          %u frames (peak %u), %u grows, %u failed, %u frames trimmed\n",
+			stats.heap_frames, stats.heap_peak_frames, stats.heap_grows, stats.heap_grow_failures, stats.heap_trimmed_frames);
+	printf("slab cache         size   used/total  slabs    bytes   allocs  grows\n");
+	for(unsigned i=0; i<stats.slab_cache_count; i++) {
+		slab_stats_t* c = &stats.slab_caches[i];
+		printf("%-16s %6u %6u/%-6u %5u %8u %8u %6u\n", c->name, c->object_size, c->objects_used,
+				c->objects_total, c->slabs, c->bytes, c->allocs, c->grows);
+	}
+
+	return 0;
+}
+
+static int watermarks(int argc, char **argv) {
+
+	if (argc != 3) {
+		printf("usage: %s <low> <high>\n", argv[0]);
+		return 1;
+	}
+
+	if (vm_set_watermarks(atoi(argv[1]), atoi(argv[2])) != 0) {
+		printf("%s: invalid watermarks\n", argv[0]);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+static int heaplimit(int argc, char **argv) {
+
+	if (argc != 3) {
+		printf("usage: %s <pid> <kbytes>\n", argv[0]);
+		return 1;
+	}
+
+	if (vm_set_heap_limit(atoi(argv[1]), atoi(argv[2]) * 1024) != 0) {
+		printf("%s: invalid pid or limit\n", argv[0]);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+static int quota(int argc, char **argv) {
+
+	if (argc != 3) {
+		printf("usage: %s <pid> <frames>\n", argv[0]);
+		return 1;
+	}
+
+	if (vm_set_frame_quota(atoi(argv[1]), atoi(argv[2])) != 0) {
+		printf("%s: invalid pid\n", argv[0]);
+		return 1;
+	}
+
+	return 0;
+}
+
 
 struct command {
 	char *name;
@@ -304,6 +437,10 @@ struct command commands[] = {
 		{ "benchmark", benchmark },
 		{ "thrash", thrash },
 		{ "kill", kill_process },
+		{ "vmstat", vmstat },
+		{ "watermarks", watermarks },
+		{ "heaplimit", heaplimit },
+		{ "quota", quota },
 };
 
 int main(void) {
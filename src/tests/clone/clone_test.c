@@ -0,0 +1,79 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sos.h>
+
+#define PAGE_SIZE 4096
+/** Pages of heap the parent fills before cloning */
+#define NPAGES 256
+/** Number of clones created one after another */
+#define NCLONES 4
+
+static char* pages[NPAGES];
+
+
+/**
+ * Checks that every page holds the pattern written by `writer`.
+ */
+static void check_pages(int writer) {
+	for (int i = 0; i < NPAGES; i++) {
+		assert(pages[i][0] == (char) (writer + i));
+		assert(pages[i][PAGE_SIZE-1] == (char) writer);
+	}
+}
+
+
+static void fill_pages(int writer) {
+	for (int i = 0; i < NPAGES; i++) {
+		pages[i][0] = (char) (writer + i);
+		pages[i][PAGE_SIZE-1] = (char) writer;
+	}
+}
+
+
+/**
+ * Tests process_clone: the clones see the memory of the parent
+ * at the time of the clone and writes on both sides stay private.
+ * Prints the time a clone takes and the copy on write faults
+ * caused by writing all pages in the clone.
+ **/
+int main(void) {
+	for (int i = 0; i < NPAGES; i++) {
+		pages[i] = malloc(PAGE_SIZE);
+		assert(pages[i] != NULL);
+	}
+	fill_pages(0);
+
+	printf("clone | clone time (us) | cow copies\n");
+
+	for (int c = 1; c <= NCLONES; c++) {
+		vm_stats_t before, after;
+		vm_stats(&before);
+
+		uint64_t start = time_stamp();
+		pid_t pid = process_clone();
+		uint64_t end = time_stamp();
+
+		if (pid == 0) {
+			// clone: sees the parent's memory, writes its own copy
+			check_pages(c - 1);
+			fill_pages(100 + c);
+			check_pages(100 + c);
+			return 0;
+		}
+
+		assert(pid > 0);
+		process_wait(pid);
+		vm_stats(&after);
+
+		// the writes of the clone did not change our memory
+		check_pages(c - 1);
+		fill_pages(c);
+
+		printf("%5d | %15llu | %10u\n", c, end - start, after.cow_copies - before.cow_copies);
+	}
+
+	printf("clone test passed\n");
+	return 0;
+}
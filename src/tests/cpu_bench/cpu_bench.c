@@ -0,0 +1,82 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sos.h>
+
+#define REPETITIONS 5
+#define SIEVE_SIZE (256 * 1024)
+#define MATRIX_SIZE 64
+
+static char sieve[SIEVE_SIZE];
+static int a[MATRIX_SIZE][MATRIX_SIZE];
+static int b[MATRIX_SIZE][MATRIX_SIZE];
+static int c[MATRIX_SIZE][MATRIX_SIZE];
+
+
+/**
+ * Counts the primes below SIEVE_SIZE (streams over 64 pages of data).
+ */
+static int count_primes(void) {
+	int primes = 0;
+
+	memset(sieve, 1, SIEVE_SIZE);
+	for (int i = 2; i < SIEVE_SIZE; i++) {
+		if (!sieve[i])
+			continue;
+
+		primes++;
+		for (int j = 2 * i; j < SIEVE_SIZE; j += i)
+			sieve[j] = 0;
+	}
+
+	return primes;
+}
+
+
+/**
+ * Multiplies two matrices (small working set, lots of reuse).
+ */
+static int multiply(void) {
+	for (int i = 0; i < MATRIX_SIZE; i++) {
+		for (int j = 0; j < MATRIX_SIZE; j++) {
+			a[i][j] = i + j;
+			b[i][j] = i - j;
+		}
+	}
+
+	for (int i = 0; i < MATRIX_SIZE; i++) {
+		for (int j = 0; j < MATRIX_SIZE; j++) {
+			int sum = 0;
+			for (int k = 0; k < MATRIX_SIZE; k++)
+				sum += a[i][k] * b[k][j];
+			c[i][j] = sum;
+		}
+	}
+
+	return c[MATRIX_SIZE - 1][MATRIX_SIZE - 1];
+}
+
+
+/**
+ * CPU bound workload which does no system calls while it is measured.
+ * Used to compare cached and uncached user mappings (see
+ * USER_MAPPINGS_CACHED in pager.c). The first run includes the page
+ * faults for the data.
+ **/
+int main(void) {
+	for (int i = 0; i < REPETITIONS; i++) {
+		uint64_t start = time_stamp();
+		int primes = count_primes();
+		uint64_t middle = time_stamp();
+		int result = multiply();
+		uint64_t end = time_stamp();
+
+		assert(primes == 23000);
+		printf("run %d: sieve %u us, matrix %u us (result %d)\n", i,
+				(unsigned) (middle - start), (unsigned) (end - middle), result);
+	}
+
+	return 0;
+}
@@ -0,0 +1,88 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sos.h>
+
+#define PAGE_SIZE 4096
+#define MAX_PROCESSES 32
+#define POLL_DELAY 10
+
+/** Number of pages of the killed process */
+static const unsigned process_sizes[] = { 16, 128, 512 };
+/** Number of pages we keep resident ourselves (system wide resident set) */
+static const unsigned ballast_sizes[] = { 0, 256, 768 };
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static char* ballast[1024];
+static unsigned ballast_pages = 0;
+
+
+/**
+ * Grows our own resident set to `pages` pages.
+ */
+static void grow_ballast(unsigned pages) {
+	for (; ballast_pages < pages; ballast_pages++) {
+		ballast[ballast_pages] = malloc(PAGE_SIZE);
+		assert(ballast[ballast_pages] != NULL);
+		ballast[ballast_pages][0] = 1;
+	}
+}
+
+
+/**
+ * Returns the size (in pages) of a process or -1 if it doesn't exist.
+ */
+static int process_size(pid_t pid) {
+	process_t processes[MAX_PROCESSES];
+	int n = process_status(processes, MAX_PROCESSES);
+
+	for (int i = 0; i < n; i++) {
+		if (processes[i].pid == pid)
+			return processes[i].size;
+	}
+
+	return -1;
+}
+
+
+/**
+ * Measures the latency of process_delete depending on the size of the
+ * deleted process and the number of pages resident in the system.
+ * A memory hog (see tests/memhog) is started and killed as soon as it
+ * reached the requested size.
+ **/
+int main(void) {
+	printf("ballast pages | process pages | delete time (us)\n");
+
+	for (unsigned b = 0; b < ARRAY_SIZE(ballast_sizes); b++) {
+		grow_ballast(ballast_sizes[b]);
+
+		for (unsigned s = 0; s < ARRAY_SIZE(process_sizes); s++) {
+			pid_t pid = process_create("hog");
+			if (pid < 0) {
+				printf("Could not start hog, is it on the NFS share?\n");
+				return 1;
+			}
+
+			int size;
+			while ((size = process_size(pid)) >= 0 && size < (int) process_sizes[s])
+				sleep(POLL_DELAY);
+
+			if (size < 0) {
+				printf("hog (pid %d) died before reaching %u pages\n", pid, process_sizes[s]);
+				continue;
+			}
+
+			uint64_t start = time_stamp();
+			int ret = process_delete(pid);
+			uint64_t end = time_stamp();
+			assert(ret == pid);
+
+			printf("%13u | %13d | %u\n", ballast_pages, size, (unsigned) (end - start));
+		}
+	}
+
+	return 0;
+}
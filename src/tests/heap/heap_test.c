@@ -0,0 +1,77 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sos.h>
+
+#define PAGE_SIZE 4096
+/** Size of the sparse heap area (larger than the old fixed heap) */
+#define SPARSE_SIZE (32*1024*1024)
+/** Stride between the pages read and written in the sparse area */
+#define STRIDE (64*1024)
+/** Depth of the recursion used to grow the stack */
+#define RECURSION_DEPTH 128
+
+
+/**
+ * Uses 16 KB of stack per call so the stack grows
+ * beyond its initial size.
+ */
+static int recurse(int depth) {
+	volatile char frame[PAGE_SIZE * 4];
+	frame[0] = (char) depth;
+
+	if (depth == 0)
+		return frame[0];
+
+	return recurse(depth - 1) + frame[0];
+}
+
+
+/**
+ * Tests the growable heap and stack: a sparse heap area which is
+ * only read maps the zero page, the first write gives a page its own
+ * frame and shrinking the heap frees the pages again.
+ **/
+int main(void) {
+	vm_stats_t before, after;
+
+	// sparse heap: read every page in the stride, then write a few
+	char* base = sbrk(SPARSE_SIZE);
+	assert(base != (void*) -1);
+
+	vm_stats(&before);
+	for (int i = 0; i < SPARSE_SIZE; i += STRIDE)
+		assert(base[i] == 0);
+	vm_stats(&after);
+	printf("zero page maps for %d read pages: %u\n", SPARSE_SIZE / STRIDE, after.zero_page_maps - before.zero_page_maps);
+
+	for (int i = 0; i < SPARSE_SIZE; i += 16 * STRIDE)
+		base[i] = 1;
+	for (int i = 0; i < SPARSE_SIZE; i += STRIDE)
+		assert(base[i] == ((i % (16 * STRIDE)) == 0));
+
+	// shrink the heap again and grow it, the pages have to be zero
+	assert(sbrk(-SPARSE_SIZE) == base + SPARSE_SIZE);
+	assert(sbrk(SPARSE_SIZE) == base);
+	for (int i = 0; i < SPARSE_SIZE; i += STRIDE)
+		assert(base[i] == 0);
+	assert(sbrk(-SPARSE_SIZE) == base + SPARSE_SIZE);
+
+	// the heap limit holds
+	assert(sbrk(512*1024*1024) == (void*) -1);
+
+	// stack growth beyond the initial megabyte
+	vm_stats(&before);
+	recurse(RECURSION_DEPTH);
+	vm_stats(&after);
+	printf("stack growths: %u\n", after.stack_growths - before.stack_growths);
+
+	// malloc is backed by sbrk as well
+	void* large = malloc(8*1024*1024);
+	assert(large != NULL);
+	free(large);
+
+	printf("heap test passed\n");
+	return 0;
+}
@@ -0,0 +1,39 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sos.h>
+
+#define PAGE_SIZE 4096
+/** Stay a bit below the 4 MB heap limit (malloc needs some space too) */
+#define MAX_PAGES 1000
+/** Pages touched before we sleep for a while */
+#define PAGES_PER_STEP 16
+#define STEP_DELAY 10
+
+/**
+ * Grows slowly by touching one new heap page after another
+ * and then keeps touching its pages forever. Used by other
+ * tests which need a process of a certain size (they watch
+ * the size in process_status and kill the hog when it's
+ * large enough).
+ **/
+int main(void) {
+	char* pages[MAX_PAGES];
+
+	for (int i = 0; i < MAX_PAGES; i++) {
+		pages[i] = malloc(PAGE_SIZE);
+		assert(pages[i] != NULL);
+		pages[i][0] = i;
+
+		if (i % PAGES_PER_STEP == 0)
+			sleep(STEP_DELAY);
+	}
+
+	for (;;) {
+		for (int i = 0; i < MAX_PAGES; i++) {
+			pages[i][0]++;
+		}
+		sleep(STEP_DELAY);
+	}
+}
@@ -0,0 +1,80 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sos.h>
+
+/** Number of idle processes started for the measurement */
+#define PROCESSES 16
+/** Time the processes get to fault in their initial pages (ms) */
+#define SETTLE_DELAY 2000
+/** Size of a 1st level table with an entry for every 1 MB region */
+#define FLAT_INDEX_SIZE (4096 * 4)
+
+
+/**
+ * Returns the statistics of a slab cache of the root server
+ * (NULL if it has not been used yet).
+ */
+static slab_stats_t* find_cache(vm_stats_t* stats, const char* name) {
+	for (unsigned i = 0; i < stats->slab_cache_count; i++) {
+		if (strcmp(stats->slab_caches[i].name, name) == 0)
+			return &stats->slab_caches[i];
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Measures the page table metadata the root server keeps per process.
+ * Idle processes (see tests/infinite_loop) are started and the growth
+ * of the page table caches is divided by their number.
+ **/
+int main(void) {
+	vm_stats_t before, after;
+	pid_t pids[PROCESSES];
+	int started = 0;
+
+	vm_stats(&before);
+
+	for (; started < PROCESSES; started++) {
+		pids[started] = process_create("til");
+		if (pids[started] < 0)
+			break;
+	}
+
+	if (started == 0) {
+		printf("Could not start til, is it on the NFS share?\n");
+		return 1;
+	}
+
+	sleep(SETTLE_DELAY);
+	vm_stats(&after);
+
+	for (int i = 0; i < started; i++)
+		process_delete(pids[i]);
+
+	slab_stats_t* index_before = find_cache(&before, "page index");
+	slab_stats_t* index_after = find_cache(&after, "page index");
+	slab_stats_t* tables_before = find_cache(&before, "page table");
+	slab_stats_t* tables_after = find_cache(&after, "page table");
+	assert(index_after != NULL && tables_after != NULL);
+
+	unsigned tables = tables_after->objects_used - (tables_before ? tables_before->objects_used : 0);
+	unsigned slab_bytes = (index_after->bytes - (index_before ? index_before->bytes : 0)) +
+			(tables_after->bytes - (tables_before ? tables_before->bytes : 0));
+
+	unsigned index_size = index_after->object_size;
+	unsigned table_size = tables_after->object_size;
+	unsigned per_process = index_size + tables * table_size / started;
+	unsigned flat = FLAT_INDEX_SIZE + tables * table_size / started;
+
+	printf("%d processes, %u.%02u 2nd level tables each\n", started, tables / started, (tables * 100 / started) % 100);
+	printf("page index:            %u bytes\n", index_size);
+	printf("page table metadata:   %u bytes/process (%u bytes with a flat 1st level table)\n", per_process, flat);
+	printf("root server heap used: %u bytes/process (including slab overhead)\n", slab_bytes / started);
+
+	return 0;
+}
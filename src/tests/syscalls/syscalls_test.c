@@ -61,11 +61,6 @@ int main(void) {
 	assert(process_wait(-2) == -1);
 	assert(process_wait(-33) == -1);
 
-	// Test get process name
-	char name[32];
-	assert(process_get_name(NULL) == -1);
-	assert(process_get_name(name) == -1);
-
 
 	///
 	/// IO SYSCALLS
@@ -139,6 +134,7 @@ int main(void) {
 	close(fd);
 
 	// Test getdirent
+	char name[32];
 	assert(getdirent(0, NULL, 10) == -1); // invalid buffer
 	assert(getdirent(9999, name, 10) == -1); // non existent entry
 	assert(getdirent(-1, name, 10) == -1); // non existent entry
@@ -4,7 +4,7 @@
 
 #include <sos.h>
 
-#define NPAGES 10
+#define NPAGES 512
 #define NUMINTPERPAGE (1<<10)
 static int thrash(void) {
 
@@ -43,5 +43,15 @@ static int thrash(void) {
  * the kill command.
  **/
 int main(void) {
+	vm_stats_t before, after;
+
+	vm_stats(&before);
 	thrash();
+	vm_stats(&after);
+
+	// faults of other processes are counted as well, so run this alone
+	printf("page faults: %u, large pages mapped: %u (%u fallbacks)\n",
+			after.page_faults - before.page_faults,
+			after.large_page_maps - before.large_page_maps,
+			after.large_page_fallbacks - before.large_page_fallbacks);
 }